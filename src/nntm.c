@@ -1,16 +1,43 @@
 /*
  * todo‑viewer.c  – ncurses list with date / priority / text columns
  */
+#define _GNU_SOURCE  // memmem, strcasestr, accept4
+#define NCURSES_WIDECHAR 1  // cchar_t rows, see render cache
 #include <locale.h>
 #include <ncurses.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
+#include <malloc.h>  // malloc_trim
 #include <stdbool.h>
 #include <time.h>
 #include <ctype.h>
 #include <unistd.h>  // for fork(), execl(), _exit()
 #include <fcntl.h>  // for open()
 #include <libgen.h> // for dirname
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <wchar.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/inotify.h>
+#include <ftw.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <termios.h>
+#ifdef NNTM_CRYPTO
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define MAX_TODOS 1000
 #define MAX_LINE  512
@@ -23,17 +50,28 @@ typedef struct {
     char priority[4];               /* "(A)" .. "(Z)" or ""     */
     char type[MAX_TYPE];            /* @context / @project      */
     char text[MAX_LINE];            /* whatever is left         */
+    int  id;                        /* session id, see alloc_id */
 } Todo;
 
 static Todo   todos[MAX_TODOS];
 static int    todo_count = 0;
 
+/* ids are recycled so they always fit in [0, MAX_TODOS) */
+static int    free_ids[MAX_TODOS];
+static int    free_id_count = 0;
+static int    id_slot[MAX_TODOS];   /* id -> index in todos[], -1 if unused */
+
+static unsigned long store_revision = 0;   /* bumped by every change */
+static unsigned      row_version[MAX_TODOS];   /* bumped when an item changes, see render cache */
+
 static char  *types[MAX_TODOS];
 static int    type_count = 0;
 static int    selected_type  = 0;
 static int    selected_index = 0;
 
 static bool   show_help     = false;
+static bool   show_next     = false;
+static int    next_selected = 0;
 static int    scroll_offset = 0;
 
 static const char *todo_filename = NULL;
@@ -42,6 +80,24 @@ static bool sort_descending = false;
 static bool sort_date_descending = false;
 
 static void save_todos_to_file(void);
+static void parse_todo_line(const char *line, Todo *t);
+static void write_todo_line(FILE *f, const Todo *t);
+static int format_todo_line(char *buf, size_t size, const Todo *t);
+static void persist_lines(int lo, int hi);
+static bool sync_adopt(void);
+static void sync_flush(void);
+static void sync_loaded(void);
+static void comp_rebuild(void);
+static void pressure_event(void);
+static int pressure_stats(char *buf, size_t size);
+
+static void sync_start(void);
+
+static int pressure_fd = -1;   /* PSI trigger on /proc/pressure/memory, see pressure */
+
+#define SYNC_NAME 64
+static const char *sync_dir = NULL;            /* --sync, see sync */
+static char sync_device[SYNC_NAME] = "";       /* --device */
 
 #ifndef PATH_MAX
 #define PATH_MAX 4096
@@ -49,19 +105,205 @@ static void save_todos_to_file(void);
 
 char archive_path[PATH_MAX];
 
+/* path of a file living next to the todo file, e.g. todo.archive.txt */
+static void sidecar_path(char *out, size_t size, const char *name)
+{
+    char tmp[PATH_MAX];
+    strncpy(tmp, todo_filename, sizeof tmp);
+    tmp[sizeof tmp - 1] = '\0';
+    snprintf(out, size, "%s/%s", dirname(tmp), name);
+}
+
+/*
+ * A file rewritten through a temp file and one rename. The temp file sits
+ * next to the file a symlink points to and gets the old file's mode, so
+ * the rename neither replaces the link nor loosens 0600.
+ */
+typedef struct {
+    FILE *f;
+    char  real[PATH_MAX], tmp[PATH_MAX + 16];
+} Replace;
+
+static bool replace_open(Replace *r, const char *path, const char *suffix)
+{
+    struct stat st;
+    mode_t mode;
+    if (realpath(path, r->real) && stat(r->real, &st) == 0) {
+        mode = st.st_mode & 07777;
+    } else if (errno == ENOENT) {
+        snprintf(r->real, sizeof r->real, "%s", path);
+        mode = umask(0);
+        umask(mode);
+        mode = 0666 & ~mode;
+    } else {
+        return false;
+    }
+    snprintf(r->tmp, sizeof r->tmp, "%s%s", r->real, suffix);
+    int fd = open(r->tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    r->f = fd >= 0 && fchmod(fd, mode) == 0 ? fdopen(fd, "w") : NULL;
+    if (!r->f) {
+        if (fd >= 0) close(fd);
+        unlink(r->tmp);
+        return false;
+    }
+    return true;
+}
+
+static void replace_abort(Replace *r)
+{
+    fclose(r->f);
+    unlink(r->tmp);
+}
 
-static const char *exec_script = NULL;
+/* flush to disk and swap in; the temp file is gone either way */
+static bool replace_commit(Replace *r)
+{
+    bool ok = fflush(r->f) == 0 && fsync(fileno(r->f)) == 0;
+    ok = fclose(r->f) == 0 && ok && rename(r->tmp, r->real) == 0;
+    if (!ok) unlink(r->tmp);
+    return ok;
+}
 
 /* ────────────────────────────────────────────────────────── helpers ── */
 
-static void run_exec_hook(const char *prefix, const char *text)
+/* collect exited hook processes so they do not linger as zombies */
+static void reap_children(void)
+{
+    while (waitpid(-1, NULL, WNOHANG) > 0)
+        ;
+}
+
+/* FNV-1a */
+static uint64_t hash64(const char *s, size_t n)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < n; ++i) h = (h ^ (unsigned char)s[i]) * 1099511628211ULL;
+    return h;
+}
+
+static int pool_threads(void)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus < 1 ? 1 : cpus > 64 ? 64 : (int)cpus;
+}
+
+/* one worker per CPU, at most one per job; each takes jobs off a shared counter */
+static void run_pool(void *(*worker)(void *), int jobs)
 {
-    if (!exec_script || !text || strlen(text) == 0) return;
+    int nthreads = pool_threads();
+    if (nthreads > jobs) nthreads = jobs;
+
+    pthread_t threads[64];
+    int started = 0;
+    for (; started < nthreads; ++started)
+        if (pthread_create(&threads[started], NULL, worker, NULL) != 0) break;
+    if (started == 0) worker(NULL);
+    for (int i = 0; i < started; ++i) pthread_join(threads[i], NULL);
+}
+
+/* ─────────────────────────────────────────────────────────── hooks ── */
+
+/*
+ * Routing table for --hook / --exec. Each hook subscribes to a set of
+ * events and may narrow them by context, priority range and tags; the
+ * table keeps one bitmask of hooks per event, so an event nobody listens
+ * to stops at one load and a process is forked only for hooks that match.
+ */
+#define MAX_HOOKS     32
+#define HOOK_FILTERS  8
+
+enum { EV_ADD, EV_COMPLETE, EV_UNCOMPLETE, EV_ESCALATE, EV_REPLACE, EV_COUNT };
+
+static const char *hook_events[EV_COUNT]  = { "add", "complete", "uncomplete", "escalate", "replace" };
+static const char *hook_prefix[EV_COUNT]  = { "Added: ", "Completed: ", "Uncompleted: ", "Escalated: ", "Replaced: " };
+
+typedef struct {
+    const char *script;
+    char  ctx[HOOK_FILTERS][MAX_TYPE];  /* any of these contexts, none = all */
+    int   nctx;
+    char  pmin, pmax;                   /* priority range, 0 = any          */
+    char  tag[HOOK_FILTERS][MAX_TYPE];  /* all of these words: "key:" or "key:value" */
+    int   ntag;
+} Hook;
+
+static Hook     hooks[MAX_HOOKS];
+static int      hook_count = 0;
+static uint32_t hook_route[EV_COUNT];   /* event -> hooks subscribed to it */
+
+/* "add,complete,@work,(A-B),due:" -> events and filters; false if malformed */
+static bool hook_add(const char *spec, const char *script)
+{
+    if (hook_count >= MAX_HOOKS) return false;
+    Hook h = { .script = script };
+    uint32_t events = 0;
+
+    char buf[256];
+    snprintf(buf, sizeof buf, "%s", spec);
+    for (char *save = NULL, *w = strtok_r(buf, ",", &save); w; w = strtok_r(NULL, ",", &save)) {
+        size_t len = strlen(w);
+        if (strcmp(w, "all") == 0) {
+            events = (1u << EV_COUNT) - 1;
+        } else if (w[0] == '@' && len > 1 && len <= MAX_TYPE && h.nctx < HOOK_FILTERS) {
+            memcpy(h.ctx[h.nctx++], w + 1, len);
+        } else if (w[0] == '(' && w[len - 1] == ')' && (len == 3 || (len == 5 && w[2] == '-'))) {
+            h.pmin = (char)toupper((unsigned char)w[1]);
+            h.pmax = (char)toupper((unsigned char)w[len - 2]);
+            if (!isupper((unsigned char)h.pmin) || !isupper((unsigned char)h.pmax) || h.pmin > h.pmax) return false;
+        } else if (strchr(w, ':') && w[0] != ':' && len < MAX_TYPE && h.ntag < HOOK_FILTERS) {
+            memcpy(h.tag[h.ntag++], w, len + 1);
+        } else {
+            int ev = 0;
+            while (ev < EV_COUNT && strcmp(w, hook_events[ev]) != 0) ++ev;
+            if (ev == EV_COUNT) return false;
+            events |= 1u << ev;
+        }
+    }
+    if (!events) return false;
+
+    hooks[hook_count] = h;
+    for (int ev = 0; ev < EV_COUNT; ++ev)
+        if (events & (1u << ev)) hook_route[ev] |= 1u << hook_count;
+    hook_count++;
+    return true;
+}
+
+/* a word of text equal to tag ("key:value"), or starting with it ("key:") */
+static bool hook_has_word(const char *text, const char *tag)
+{
+    size_t tlen = strlen(tag);
+    bool prefix = tag[tlen - 1] == ':';
+    for (const char *p = strstr(text, tag); p; p = strstr(p + 1, tag)) {
+        if (p != text && !isspace((unsigned char)p[-1])) continue;
+        if (prefix || p[tlen] == '\0' || isspace((unsigned char)p[tlen])) return true;
+    }
+    return false;
+}
+
+static bool hook_matches(const Hook *h, const Todo *t)
+{
+    if (t->text[0] == '\0') return false;
+    if (h->nctx) {
+        int i = 0;
+        while (i < h->nctx && strcmp(h->ctx[i], t->type) != 0) ++i;
+        if (i == h->nctx) return false;
+    }
+    if (h->pmin) {
+        // a completed item keeps its priority as a trailing pri:X
+        const char *pri = strstr(t->text, " pri:");
+        char p = t->priority[0] == '(' ? t->priority[1]
+               : pri && strlen(pri) == 6 ? pri[5] : 0;
+        if (p < h->pmin || p > h->pmax) return false;
+    }
+    for (int i = 0; i < h->ntag; ++i)
+        if (!hook_has_word(t->text, h->tag[i])) return false;
+    return true;
+}
 
+/* fork the script with one argument per text, without waiting for it */
+static void hook_spawn(const char *script, const char *prefix, const char **texts, int n)
+{
     pid_t pid = fork();
     if (pid == 0) {
-        // In child process
-        // Redirect stdout and stderr to /dev/null
         int devnull = open("/dev/null", O_WRONLY);
         if (devnull != -1) {
             dup2(devnull, STDOUT_FILENO);
@@ -69,519 +311,7424 @@ static void run_exec_hook(const char *prefix, const char *text)
             close(devnull);
         }
 
-        char msg[MAX_LINE * 2];
-        snprintf(msg, sizeof(msg), "%s%s", prefix, text);
+        char **argv = calloc((size_t)n + 2, sizeof *argv);
+        if (!argv) _exit(127);
+        argv[0] = (char *)script;
+        for (int i = 0; i < n; ++i) {
+            size_t len = strlen(prefix) + strlen(texts[i]) + 1;
+            argv[i + 1] = malloc(len);
+            if (argv[i + 1]) snprintf(argv[i + 1], len, "%s%s", prefix, texts[i]);
+        }
+        execv(script, argv);
+        _exit(127);
+    }
+}
 
-        execl(exec_script, exec_script, msg, (char *)NULL);
-        _exit(127); // only reached if execl fails
+/* one call per matching hook for a batch of items, each item its own argument */
+static void run_hooks(int ev, Todo **items, int n)
+{
+    uint32_t mask = hook_route[ev];
+    if (!mask || n <= 0) return;
+    reap_children();
+
+    static const char *texts[MAX_TODOS];
+    for (int h = 0; mask; ++h, mask >>= 1) {
+        if (!(mask & 1)) continue;
+        int m = 0;
+        for (int i = 0; i < n; ++i)
+            if (hook_matches(&hooks[h], items[i])) texts[m++] = items[i]->text;
+        if (m) hook_spawn(hooks[h].script, hook_prefix[ev], texts, m);
     }
-    // Parent continues immediately
 }
 
-static void archive_completed_todos(void)
+static void run_hook(int ev, Todo *t)
 {
-    // Derive archive path
-    char archive_path[PATH_MAX];
-    strncpy(archive_path, todo_filename, sizeof(archive_path));
-    archive_path[sizeof(archive_path) - 1] = '\0';
-    char *dir = dirname(archive_path);
+    run_hooks(ev, &t, 1);
+}
 
-    snprintf(archive_path, sizeof archive_path, "%s/todo.archive.txt", dir);
+/* ─────────────────────────────────────────────────────── item ids ── */
 
-    FILE *f = fopen(archive_path, "a");
-    if (!f) {
-        perror("archive write");
-        return;
+static void reset_ids(void)
+{
+    free_id_count = 0;
+    for (int id = MAX_TODOS - 1; id >= 0; --id) {
+        free_ids[free_id_count++] = id;
+        id_slot[id] = -1;
     }
+}
 
-    // Write all completed todos and remove them from the list
-    int write_count = 0;
-    for (int i = 0; i < todo_count; ) {
-        Todo *t = &todos[i];
-        if (!t->completed) {
-            i++;
-            continue;
-        }
-
-        fprintf(f, "x %s %s @%s %s\n", t->completion_date, t->date, t->type, t->text);
+static int alloc_id(void)
+{
+    if (free_id_count == 0) return -1;
+    int id = free_ids[--free_id_count];
+    row_version[id]++;   // a new item in a recycled slot: its cached row is stale
+    return id;
+}
 
-        // Shift remaining todos left
-        for (int j = i; j < todo_count - 1; ++j)
-            todos[j] = todos[j + 1];
+static void free_id(int id)
+{
+    if (id < 0) return;
+    id_slot[id] = -1;
+    free_ids[free_id_count++] = id;
+}
 
-        todo_count--;
-        write_count++;
-    }
+// Call after anything that moves Todo structs around in todos[]
+static void reindex_todos(void)
+{
+    for (int i = 0; i < todo_count; ++i)
+        id_slot[todos[i].id] = i;
+    store_revision++;
+}
 
-    fclose(f);
-    if (write_count > 0) save_todos_to_file();
+static Todo *todo_by_id(int id)
+{
+    if (id < 0 || id >= MAX_TODOS || id_slot[id] < 0) return NULL;
+    return &todos[id_slot[id]];
 }
 
+/* ──────────────────────────────────────────────────────────── dates ── */
 
-static void add_new_todo(void)
+/* days since 1970‑01‑01 for a YYYY‑MM‑DD string, -1 if malformed */
+static int day_number(const char *s)
 {
-    if (todo_count >= MAX_TODOS) return;
+    int y, m, d;
+    if (!s || strlen(s) < 10 || sscanf(s, "%4d-%2d-%2d", &y, &m, &d) != 3)
+        return -1;
+    if (m < 1 || m > 12 || d < 1 || d > 31) return -1;
+
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
 
-    Todo new_todo;
-    memset(&new_todo, 0, sizeof(Todo));
+/* inverse of day_number: YYYY-MM-DD into out[11] */
+static void format_day(int day, char *out)
+{
+    int z = day + 719468;
+    int era = (z >= 0 ? z : z - 146096) / 146097;
+    int doe = z - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+    int d = doy - (153 * mp + 2) / 5 + 1;
+    int m = mp < 10 ? mp + 3 : mp - 9;
+    char buf[32];
+    snprintf(buf, sizeof buf, "%04d-%02d-%02d", yoe + era * 400 + (m <= 2), m, d);
+    memcpy(out, buf, 10);
+    out[10] = '\0';
+}
 
-    // Set today's date
+static long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+static int today_number(void)
+{
+    char buf[11];
     time_t now = time(NULL);
-    struct tm *tm = localtime(&now);
-    strftime(new_todo.date, sizeof new_todo.date, "%Y-%m-%d", tm);
+    strftime(buf, sizeof buf, "%Y-%m-%d", localtime(&now));
+    return day_number(buf);
+}
 
-    // Set @type from current context
-    strncpy(new_todo.type, types[selected_type], MAX_TYPE - 1);
+/* value of a "key:YYYY-MM-DD" tag in text as a day number, -1 if absent */
+static int tag_day(const char *text, const char *key)
+{
+    size_t klen = strlen(key);
+    for (const char *p = strstr(text, key); p; p = strstr(p + 1, key)) {
+        if ((p == text || isspace((unsigned char)p[-1])) && p[klen] == ':')
+            return day_number(p + klen + 1);
+    }
+    return -1;
+}
 
-    // Default to not completed
-    new_todo.completed = false;
+/* ──────────────────────────────────────────────────── indexed heap ── */
 
-    // Prompt for text
-    echo();
-    curs_set(1);
-    move(LINES - 1, 0);
-    clrtoeol();
-    attron(COLOR_PAIR(2) | A_BOLD);
-    printw("New todo: ");
-    attroff(COLOR_PAIR(2) | A_BOLD);
-    getnstr(new_todo.text, MAX_LINE - 1);
-    noecho();
-    curs_set(0);
+/*
+ * Max-heap of item ids with an id -> slot index, so a single item can be
+ * re-keyed or removed in O(log n) without searching.
+ */
+typedef struct {
+    int    heap[MAX_TODOS];
+    int    pos[MAX_TODOS];          /* id -> heap slot, -1 if absent */
+    double key[MAX_TODOS];
+    int    n;
+} IndexedHeap;
+
+static void ih_init(IndexedHeap *h)
+{
+    h->n = 0;
+    for (int i = 0; i < MAX_TODOS; ++i) h->pos[i] = -1;
+}
 
-    if (strlen(new_todo.text) == 0) return;
+static void ih_swap(IndexedHeap *h, int a, int b)
+{
+    int t = h->heap[a];
+    h->heap[a] = h->heap[b];
+    h->heap[b] = t;
+    h->pos[h->heap[a]] = a;
+    h->pos[h->heap[b]] = b;
+}
 
-    // Insert new todo right after the currently selected item
-    int shown = 0;
-    for (int i = 0; i < todo_count; ++i) {
-        if (strcmp(todos[i].type, types[selected_type]) != 0) continue;
-
-        if (shown == selected_index) {
-            for (int j = todo_count; j > i + 1; --j)
-                todos[j] = todos[j - 1];
-            todos[i + 1] = new_todo;
-            todo_count++;
-	    run_exec_hook("Added: ", new_todo.text);
-            save_todos_to_file();
-            selected_index++;
-            return;
+static void ih_sift(IndexedHeap *h, int i)
+{
+    while (i > 0 && h->key[h->heap[i]] > h->key[h->heap[(i - 1) / 2]]) {
+        ih_swap(h, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, best = i;
+        if (l < h->n && h->key[h->heap[l]] > h->key[h->heap[best]]) best = l;
+        if (r < h->n && h->key[h->heap[r]] > h->key[h->heap[best]]) best = r;
+        if (best == i) break;
+        ih_swap(h, i, best);
+        i = best;
+    }
+}
+
+static void ih_set(IndexedHeap *h, int id, double key)
+{
+    h->key[id] = key;
+    if (h->pos[id] < 0) {
+        h->heap[h->n] = id;
+        h->pos[id] = h->n++;
+    }
+    ih_sift(h, h->pos[id]);
+}
+
+static void ih_remove(IndexedHeap *h, int id)
+{
+    int i = h->pos[id];
+    if (i < 0) return;
+    ih_swap(h, i, --h->n);
+    h->pos[id] = -1;
+    if (i < h->n) ih_sift(h, i);
+}
+
+/*
+ * Fill out[] with the ids of the n largest keys, largest first, without
+ * disturbing the heap: a small frontier heap of candidate slots is popped
+ * n times, so this is O(n log n) regardless of h->n.
+ */
+static int ih_top_n(const IndexedHeap *h, int *out, int n)
+{
+    static int frontier[MAX_TODOS];
+    int fn = 0, count = 0;
+
+    if (h->n > 0) frontier[fn++] = 0;
+
+    while (fn > 0 && count < n) {
+        int slot = frontier[0];
+        out[count++] = h->heap[slot];
+
+        frontier[0] = frontier[--fn];
+        for (int i = 0;;) {
+            int l = 2 * i + 1, r = l + 1, best = i;
+            if (l < fn && h->key[h->heap[frontier[l]]] > h->key[h->heap[frontier[best]]]) best = l;
+            if (r < fn && h->key[h->heap[frontier[r]]] > h->key[h->heap[frontier[best]]]) best = r;
+            if (best == i) break;
+            int t = frontier[i]; frontier[i] = frontier[best]; frontier[best] = t;
+            i = best;
+        }
+
+        for (int c = 2 * slot + 1; c <= 2 * slot + 2 && c < h->n; ++c) {
+            int i = fn++;
+            frontier[i] = c;
+            while (i > 0 && h->key[h->heap[frontier[i]]] > h->key[h->heap[frontier[(i - 1) / 2]]]) {
+                int t = frontier[i]; frontier[i] = frontier[(i - 1) / 2]; frontier[(i - 1) / 2] = t;
+                i = (i - 1) / 2;
+            }
         }
-        ++shown;
     }
+    return count;
+}
 
-    // fallback if no match: append at end
-    todos[todo_count++] = new_todo;
-    save_todos_to_file();
-    run_exec_hook("Added: ", new_todo.text);
+/* ──────────────────────────────────────────────────── next actions ── */
+
+#define MAX_WEIGHTS 64
+
+static struct { char type[MAX_TYPE]; double weight; } ctx_weights[MAX_WEIGHTS];
+static int ctx_weight_count = 0;
+
+static IndexedHeap next_heap;
+static int         next_day = -1;   /* day the scores were computed for */
+
+static double context_weight(const char *type)
+{
+    for (int i = 0; i < ctx_weight_count; ++i)
+        if (strcmp(ctx_weights[i].type, type) == 0) return ctx_weights[i].weight;
+    return 1.0;
 }
 
-static void group_todos_by_completed(void)
+/*
+ * Higher is more urgent: priority dominates, then due proximity, then age.
+ * The whole thing is scaled by the context weight given with --weight.
+ */
+static double next_score(const Todo *t, int today)
 {
-    Todo grouped[MAX_TODOS];
-    int group_count = 0;
-    const char *cat = types[selected_type];
+    double score = 0;
 
-    // First: uncompleted
-    for (int i = 0; i < todo_count; ++i) {
-        Todo *t = &todos[i];
-        if ((strcmp(cat, "all") == 0 || strcmp(t->type, cat) == 0) && !t->completed)
-            grouped[group_count++] = *t;
+    if (t->priority[0] == '(')
+        score += 4.0 * (26 - (toupper((unsigned char)t->priority[1]) - 'A'));
+
+    int due = tag_day(t->text, "due");
+    if (due >= 0) {
+        int left = due - today;
+        score += left <= 0 ? 80.0 : 80.0 / (1 + left);
     }
 
-    // Then: completed
-    for (int i = 0; i < todo_count; ++i) {
-        Todo *t = &todos[i];
-        if ((strcmp(cat, "all") == 0 || strcmp(t->type, cat) == 0) && t->completed)
-            grouped[group_count++] = *t;
+    int created = day_number(t->date);
+    if (created >= 0 && today > created) {
+        int age = today - created;
+        score += 0.5 * (age < 60 ? age : 60);
     }
 
-    // Reinsert grouped section
-    int j = 0;
-    for (int i = 0; i < todo_count; ++i) {
-        if (strcmp(cat, "all") == 0 || strcmp(todos[i].type, cat) == 0)
-            todos[i] = grouped[j++];
+    return score * context_weight(t->type);
+}
+
+static void next_update(const Todo *t)
+{
+    if (t->id < 0) return;
+    if (t->completed)
+        ih_remove(&next_heap, t->id);
+    else
+        ih_set(&next_heap, t->id, next_score(t, next_day));
+}
+
+static void next_rebuild(void)
+{
+    ih_init(&next_heap);
+    next_day = today_number();
+    for (int i = 0; i < todo_count; ++i)
+        next_update(&todos[i]);
+}
+
+/* rescore once when the date rolls over; ages and due distances all shift */
+static void next_check_day(void)
+{
+    if (today_number() != next_day) next_rebuild();
+}
+
+/* ─────────────────────────────────────────────────────── escalation ── */
+
+/*
+ * --escalate-age N raises an item's priority one level per N days open,
+ * --escalate-due N makes it (A) once its due: date is N days away. Each
+ * open item is scheduled on the day its next rule fires; the schedule is a
+ * heap keyed on -day, so only items whose day has come are looked at.
+ * Age steps already applied are remembered in an "escalated:" tag.
+ */
+static int         esc_age_days = 0;    /* 0: off */
+static int         esc_due_days = -1;   /* -1: off */
+static IndexedHeap esc_heap;
+
+/* set "key:value" in text (MAX_LINE), replacing an existing value; false if it does not fit */
+static bool set_text_tag(char *text, const char *key, const char *value)
+{
+    size_t klen = strlen(key), vlen = strlen(value), len = strlen(text);
+    for (char *p = strstr(text, key); p; p = strstr(p + 1, key)) {
+        if ((p != text && !isspace((unsigned char)p[-1])) || p[klen] != ':') continue;
+        char *v = p + klen + 1;
+        size_t old = strcspn(v, " \t");
+        if (len - old + vlen >= MAX_LINE) return false;
+        memmove(v + vlen, v + old, strlen(v + old) + 1);
+        memcpy(v, value, vlen);
+        return true;
     }
+    if (len + klen + vlen + 2 >= MAX_LINE) return false;
+    snprintf(text + len, MAX_LINE - len, "%s%s:%s", len ? " " : "", key, value);
+    return true;
 }
 
+/* room to record age steps; without the tag every pass counts from the creation date */
+static bool esc_tag_fits(const char *text)
+{
+    char tmp[MAX_LINE];
+    snprintf(tmp, sizeof tmp, "%s", text);
+    return set_text_tag(tmp, "escalated", "YYYY-MM-DD");
+}
 
-static int compare_date(const void *a, const void *b)
+/* the day t escalates next, -1 if never */
+static int esc_next_day(const Todo *t)
 {
-    const Todo *ta = (const Todo *)a;
-    const Todo *tb = (const Todo *)b;
+    if (t->completed) return -1;
+    int next = -1;
+
+    int prio = t->priority[0] == '(' ? toupper((unsigned char)t->priority[1]) : 0;
+    if (esc_age_days > 0 && prio > 'A' && prio <= 'Z' && esc_tag_fits(t->text)) {
+        int base = tag_day(t->text, "escalated");
+        if (base < 0) base = day_number(t->date);
+        if (base >= 0) next = base + esc_age_days;
+    }
+    if (esc_due_days >= 0 && prio != 'A') {
+        int due = tag_day(t->text, "due");
+        if (due >= 0 && (next < 0 || due - esc_due_days < next))
+            next = due - esc_due_days;
+    }
+    return next;
+}
 
-    int cmp = strncmp(ta->date, tb->date, 10);
-    return sort_date_descending ? -cmp : cmp;
+static void esc_update(const Todo *t)
+{
+    if (t->id < 0) return;
+    int day = esc_next_day(t);
+    if (day < 0)
+        ih_remove(&esc_heap, t->id);
+    else
+        ih_set(&esc_heap, t->id, -day);
 }
-static int compare_priority(const void *a, const void *b)
+
+static void esc_rebuild(void)
 {
-    const Todo *ta = (const Todo *)a;
-    const Todo *tb = (const Todo *)b;
+    ih_init(&esc_heap);
+    for (int i = 0; i < todo_count; ++i)
+        esc_update(&todos[i]);
+}
 
-    int pa = (ta->priority[0] == '(') ? ta->priority[1] : 127;
-    int pb = (tb->priority[0] == '(') ? tb->priority[1] : 127;
+/* id of an item due for escalation by today, -1 if none */
+static int esc_pending(int today)
+{
+    if (esc_heap.n == 0 || -esc_heap.key[esc_heap.heap[0]] > today) return -1;
+    return esc_heap.heap[0];
+}
 
-    return sort_descending ? pb - pa : pa - pb;
+/* ─────────────────────────────────────────────────── numeric tags ── */
+
+/*
+ * key:value tags whose value is a number or a duration (est:2h,
+ * spent:30m, pts:3) are parsed into one column per key, indexed by item
+ * id. Durations are kept in minutes. Per-context sums are adjusted on
+ * each edit; totals for any other subset are one pass over the columns.
+ */
+#define MAX_TAG_COLS 8
+#define MAX_TAG_KEY  16
+
+static char   tag_keys[MAX_TAG_COLS][MAX_TAG_KEY];
+static bool   tag_is_duration[MAX_TAG_COLS];
+static int    tag_col_count = 0;
+static double tag_vals[MAX_TAG_COLS][MAX_TODOS];
+static bool   tag_set[MAX_TAG_COLS][MAX_TODOS];
+static int    tag_ctx[MAX_TODOS];                  /* id -> types[] index */
+static double ctx_sums[MAX_TODOS][MAX_TAG_COLS];   /* types[] index -> sums */
+static double all_sums[MAX_TAG_COLS];
+
+static int type_index(const char *type)
+{
+    for (int i = 0; i < type_count; ++i)
+        if (strcmp(types[i], type) == 0) return i;
+    return -1;
 }
 
-static void sort_todos_by_date(bool descending)
+static int tag_column(const char *key, size_t len)
 {
-    Todo sorted[MAX_TODOS];
-    int count = 0;
+    for (int c = 0; c < tag_col_count; ++c)
+        if (strlen(tag_keys[c]) == len && strncmp(tag_keys[c], key, len) == 0)
+            return c;
+    if (tag_col_count >= MAX_TAG_COLS || len >= MAX_TAG_KEY) return -1;
+    memcpy(tag_keys[tag_col_count], key, len);
+    tag_keys[tag_col_count][len] = '\0';
+    return tag_col_count++;
+}
 
-    for (int i = 0; i < todo_count; ++i) {
-        if (strcmp(types[selected_type], "all") == 0 ||
-            strcmp(todos[i].type, types[selected_type]) == 0)
-        {
-            sorted[count++] = todos[i];
+/*
+ * "90", "1.5h", "2h30m", "3d" -> minutes (or a plain number).
+ * A day is 8h and a week 5d, as in effort estimates.
+ */
+static bool parse_tag_value(const char *s, size_t len, double *out, bool *duration)
+{
+    double total = 0;
+    bool unit = false;
+    const char *end = s + len;
+
+    while (s < end) {
+        char *next;
+        double v = strtod(s, &next);
+        if (next == s || next > end) return false;
+        s = next;
+        if (s == end) { total += v; break; }
+        switch (*s++) {
+        case 'm': total += v;              break;
+        case 'h': total += v * 60;         break;
+        case 'd': total += v * 60 * 8;     break;
+        case 'w': total += v * 60 * 8 * 5; break;
+        default:  return false;
         }
+        unit = true;
     }
+    *out = total;
+    *duration = unit;
+    return true;
+}
 
-    sort_date_descending = descending;
-    qsort(sorted, count, sizeof(Todo), compare_date);
+static void tags_sub(int id, double sign)
+{
+    int ctx = tag_ctx[id];
+    for (int c = 0; c < tag_col_count; ++c) {
+        if (!tag_set[c][id]) continue;
+        if (ctx >= 0) ctx_sums[ctx][c] += sign * tag_vals[c][id];
+        all_sums[c] += sign * tag_vals[c][id];
+    }
+}
 
-    int j = 0;
-    for (int i = 0; i < todo_count; ++i) {
-        if (strcmp(types[selected_type], "all") == 0 ||
-            strcmp(todos[i].type, types[selected_type]) == 0)
-        {
-            todos[i] = sorted[j++];
-        }
+static void tags_remove(int id)
+{
+    tags_sub(id, -1);
+    for (int c = 0; c < tag_col_count; ++c) tag_set[c][id] = false;
+}
+
+static void tags_update(const Todo *t)
+{
+    if (t->id < 0) return;
+    tags_remove(t->id);
+
+    for (const char *p = t->text; *p; ) {
+        while (isspace((unsigned char)*p)) p++;
+        const char *tok = p;
+        while (*p && !isspace((unsigned char)*p)) p++;
+
+        const char *colon = memchr(tok, ':', p - tok);
+        if (!colon || colon == tok || colon + 1 == p) continue;
+
+        double v;
+        bool dur;
+        if (!isalpha((unsigned char)*tok) ||
+            !parse_tag_value(colon + 1, p - colon - 1, &v, &dur)) continue;
+
+        int c = tag_column(tok, colon - tok);
+        if (c < 0) continue;
+        tag_vals[c][t->id] = v;
+        tag_set[c][t->id] = true;
+        if (dur) tag_is_duration[c] = true;
     }
+
+    tag_ctx[t->id] = type_index(t->type);
+    tags_sub(t->id, +1);
 }
 
-static void sort_todos_by_priority(bool descending)
+static void tags_rebuild(void)
 {
-    Todo sorted[MAX_TODOS];
-    int count = 0;
+    tag_col_count = 0;
+    memset(tag_set, 0, sizeof tag_set);
+    memset(ctx_sums, 0, sizeof ctx_sums);
+    memset(all_sums, 0, sizeof all_sums);
+    for (int i = 0; i < todo_count; ++i)
+        tags_update(&todos[i]);
+}
 
-    // collect matching todos
-    for (int i = 0; i < todo_count; ++i) {
-        if (strcmp(types[selected_type], "all") == 0 ||
-            strcmp(todos[i].type, types[selected_type]) == 0)
-        {
-            sorted[count++] = todos[i];
-        }
+/* totals over an arbitrary set of ids: one pass per column */
+static void tags_totals(const int *ids, int n, double *out)
+{
+    for (int c = 0; c < tag_col_count; ++c) {
+        const double *col = tag_vals[c];
+        const bool   *set = tag_set[c];
+        double sum = 0;
+        for (int i = 0; i < n; ++i)
+            if (set[ids[i]]) sum += col[ids[i]];
+        out[c] = sum;
+    }
+}
+
+static void format_tag_value(char *buf, size_t size, int col, double v)
+{
+    if (!tag_is_duration[col]) {
+        snprintf(buf, size, "%g", v);
+        return;
+    }
+    long min = (long)(v + 0.5);
+    if (min >= 60 && min % 60)
+        snprintf(buf, size, "%ldh%ldm", min / 60, min % 60);
+    else if (min >= 60)
+        snprintf(buf, size, "%ldh", min / 60);
+    else
+        snprintf(buf, size, "%ldm", min);
+}
+
+/* ──────────────────────────────────────────────────────────── regex ── */
+
+/*
+ * Filter patterns are parsed into a small tree and compiled to a Thompson
+ * NFA, which is run as a Pike VM: each text position advances the whole set
+ * of live states at once, so a match costs O(text * pattern) whatever the
+ * pattern, with no backtracking. Supported: literals, . [..] [^..] ranges,
+ * \d \w \s and their negations, other escapes, * + ? |, ( ), ^ $.
+ * A pattern without upper-case letters matches case-insensitively.
+ */
+#define RE_MAX_NODES 256
+#define RE_MAX_INST  512
+#define RE_MAX_CLASS 32
+#define RE_MAX_LITS  16
+
+enum { RN_CHAR, RN_ANY, RN_CLASS, RN_BOL, RN_EOL, RN_EMPTY,
+       RN_CAT, RN_ALT, RN_STAR, RN_PLUS, RN_QUEST };
+enum { RI_CHAR, RI_ANY, RI_CLASS, RI_BOL, RI_EOL, RI_SPLIT, RI_JMP, RI_MATCH };
+
+typedef struct { int op, c, l, r; } ReNode;          /* c: char or class index */
+typedef struct { int op, c, x, y; } ReInst;
+
+typedef struct {
+    ReInst        inst[RE_MAX_INST];
+    int           ninst;
+    unsigned char cls[RE_MAX_CLASS][32];              /* 256-bit byte sets */
+    int           ncls;
+    bool          icase;
+    char          lits[RE_MAX_LITS][MAX_LINE];        /* substrings every match contains */
+    int           nlits;
+} Regex;
+
+/* parser state, only used while compiling */
+static struct {
+    const char *p;
+    ReNode      node[RE_MAX_NODES];
+    int         n;
+    Regex      *re;
+    const char *err;
+} rp;
+
+static int re_node(int op, int c, int l, int r)
+{
+    if (rp.n >= RE_MAX_NODES) { rp.err = "pattern too long"; return 0; }
+    rp.node[rp.n] = (ReNode){ op, c, l, r };
+    return rp.n++;
+}
+
+static void cls_set(unsigned char *set, int c)
+{
+    set[c >> 3] |= 1 << (c & 7);
+    if (rp.re->icase && isalpha(c)) {
+        int o = islower(c) ? toupper(c) : tolower(c);
+        set[o >> 3] |= 1 << (o & 7);
+    }
+}
+
+/* \d \w \s (and \D \W \S) into set; false for any other escape */
+static bool cls_escape(unsigned char *set, int e)
+{
+    int lower = tolower(e);
+    if (lower != 'd' && lower != 'w' && lower != 's') return false;
+    for (int c = 1; c < 256; ++c) {
+        bool in = lower == 'd' ? isdigit(c)
+                : lower == 's' ? isspace(c)
+                : (isalnum(c) || c == '_');
+        if (in != (e != lower)) set[c >> 3] |= 1 << (c & 7);
+    }
+    return true;
+}
+
+static int re_new_class(void)
+{
+    if (rp.re->ncls >= RE_MAX_CLASS) { rp.err = "too many classes"; return -1; }
+    memset(rp.re->cls[rp.re->ncls], 0, 32);
+    return rp.re->ncls++;
+}
+
+static int re_class(void)
+{
+    int k = re_new_class();
+    if (k < 0) return 0;
+    unsigned char *set = rp.re->cls[k];
+    bool negate = *rp.p == '^';
+    if (negate) rp.p++;
+
+    for (bool first = true; *rp.p && (*rp.p != ']' || first); first = false) {
+        int c = (unsigned char)*rp.p++;
+        if (c == '\\' && *rp.p) {
+            c = (unsigned char)*rp.p++;
+            if (cls_escape(set, c)) continue;
+        }
+        if (*rp.p == '-' && rp.p[1] && rp.p[1] != ']') {
+            int hi = (unsigned char)rp.p[1];
+            rp.p += 2;
+            for (int x = c; x <= hi; ++x) cls_set(set, x);
+        } else {
+            cls_set(set, c);
+        }
+    }
+    if (*rp.p != ']') { rp.err = "missing ]"; return 0; }
+    rp.p++;
+    if (negate)
+        for (int i = 0; i < 32; ++i) set[i] = ~set[i];
+    set[0] &= ~1;                                       /* never match NUL */
+    return re_node(RN_CLASS, k, -1, -1);
+}
+
+static int re_alt(void);
+
+static int re_atom(void)
+{
+    int c = (unsigned char)*rp.p++;
+    switch (c) {
+    case '(': {
+        int n = re_alt();
+        if (*rp.p != ')') { rp.err = "missing )"; return 0; }
+        rp.p++;
+        return n;
+    }
+    case '.': return re_node(RN_ANY, 0, -1, -1);
+    case '^': return re_node(RN_BOL, 0, -1, -1);
+    case '$': return re_node(RN_EOL, 0, -1, -1);
+    case '[': return re_class();
+    case '*': case '+': case '?':
+        rp.err = "nothing to repeat";
+        return 0;
+    case '\\':
+        if (!*rp.p) { rp.err = "trailing \\"; return 0; }
+        c = (unsigned char)*rp.p++;
+        if (strchr("dDwWsS", c)) {
+            int k = re_new_class();
+            if (k < 0) return 0;
+            cls_escape(rp.re->cls[k], c);
+            return re_node(RN_CLASS, k, -1, -1);
+        }
+        if (c == 't') c = '\t';
+        break;
+    }
+    return re_node(RN_CHAR, c, -1, -1);
+}
+
+static int re_repeat(void)
+{
+    int n = re_atom();
+    while (!rp.err && *rp.p && strchr("*+?", *rp.p)) {
+        int op = *rp.p == '*' ? RN_STAR : *rp.p == '+' ? RN_PLUS : RN_QUEST;
+        rp.p++;
+        n = re_node(op, 0, n, -1);
+    }
+    return n;
+}
+
+static int re_cat(void)
+{
+    int n = -1;
+    while (!rp.err && *rp.p && *rp.p != '|' && *rp.p != ')') {
+        int m = re_repeat();
+        n = n < 0 ? m : re_node(RN_CAT, 0, n, m);
+    }
+    return n < 0 ? re_node(RN_EMPTY, 0, -1, -1) : n;
+}
+
+static int re_alt(void)
+{
+    int n = re_cat();
+    while (!rp.err && *rp.p == '|') {
+        rp.p++;
+        n = re_node(RN_ALT, 0, n, re_cat());
+    }
+    return n;
+}
+
+static int re_emit(int op, int c)
+{
+    Regex *re = rp.re;
+    if (re->ninst >= RE_MAX_INST) { rp.err = "pattern too long"; return 0; }
+    re->inst[re->ninst] = (ReInst){ op, c, 0, 0 };
+    return re->ninst++;
+}
+
+static void re_compile_node(int n)
+{
+    if (rp.err) return;
+    ReNode *nd = &rp.node[n];
+    ReInst *in = rp.re->inst;
+    int a, b;
+
+    switch (nd->op) {
+    case RN_CHAR:
+        re_emit(RI_CHAR, rp.re->icase ? tolower(nd->c) : nd->c);
+        break;
+    case RN_ANY:   re_emit(RI_ANY, 0);         break;
+    case RN_CLASS: re_emit(RI_CLASS, nd->c);   break;
+    case RN_BOL:   re_emit(RI_BOL, 0);         break;
+    case RN_EOL:   re_emit(RI_EOL, 0);         break;
+    case RN_EMPTY:                             break;
+    case RN_CAT:
+        re_compile_node(nd->l);
+        re_compile_node(nd->r);
+        break;
+    case RN_ALT:
+        a = re_emit(RI_SPLIT, 0);
+        in[a].x = a + 1;
+        re_compile_node(nd->l);
+        b = re_emit(RI_JMP, 0);
+        in[a].y = b + 1;
+        re_compile_node(nd->r);
+        in[b].x = rp.re->ninst;
+        break;
+    case RN_STAR:
+        a = re_emit(RI_SPLIT, 0);
+        in[a].x = a + 1;
+        re_compile_node(nd->l);
+        b = re_emit(RI_JMP, 0);
+        in[b].x = a;
+        in[a].y = b + 1;
+        break;
+    case RN_PLUS:
+        a = rp.re->ninst;
+        re_compile_node(nd->l);
+        b = re_emit(RI_SPLIT, 0);
+        in[b].x = a;
+        in[b].y = b + 1;
+        break;
+    case RN_QUEST:
+        a = re_emit(RI_SPLIT, 0);
+        in[a].x = a + 1;
+        re_compile_node(nd->l);
+        in[a].y = rp.re->ninst;
+        break;
+    }
+}
+
+/* end the current literal run, keeping it if it is long enough to index */
+static void re_flush_run(char *run, int *len)
+{
+    Regex *re = rp.re;
+    if (*len >= 3 && re->nlits < RE_MAX_LITS) {
+        memcpy(re->lits[re->nlits], run, *len);
+        re->lits[re->nlits++][*len] = '\0';
+    }
+    *len = 0;
+}
+
+/*
+ * Collect literal runs every match must contain: consecutive characters
+ * along the top-level concatenation, and what is inside a '+'. Anything
+ * optional or alternative ends a run and contributes nothing.
+ */
+static void re_required(int n, char *run, int *len)
+{
+    ReNode *nd = &rp.node[n];
+    switch (nd->op) {
+    case RN_CHAR:
+        if (*len < MAX_LINE - 1) run[(*len)++] = (char)tolower(nd->c);
+        break;
+    case RN_BOL: case RN_EOL: case RN_EMPTY:
+        break;
+    case RN_CAT:
+        re_required(nd->l, run, len);
+        re_required(nd->r, run, len);
+        break;
+    case RN_PLUS: {
+        re_flush_run(run, len);
+        char inner[MAX_LINE];
+        int ilen = 0;
+        re_required(nd->l, inner, &ilen);
+        re_flush_run(inner, &ilen);
+        break;
+    }
+    default:
+        re_flush_run(run, len);
+    }
+}
+
+/* compile pattern into re; NULL on success, else a short message */
+static const char *re_compile(Regex *re, const char *pattern)
+{
+    memset(re, 0, sizeof *re);
+    re->icase = true;
+    for (const char *p = pattern; *p; ++p) {
+        if (*p == '\\' && p[1]) { ++p; continue; }   // \D \W \S are not letters
+        if (isupper((unsigned char)*p)) re->icase = false;
+    }
+
+    rp.p = pattern;
+    rp.n = 0;
+    rp.re = re;
+    rp.err = NULL;
+
+    int root = re_alt();
+    if (!rp.err && *rp.p) rp.err = "unmatched )";
+    if (!rp.err) {
+        re_compile_node(root);
+        re_emit(RI_MATCH, 0);
+    }
+    if (!rp.err) {
+        char run[MAX_LINE];
+        int len = 0;
+        re_required(root, run, &len);
+        re_flush_run(run, &len);
+    }
+    return rp.err;
+}
+
+/* add pc and everything reachable from it without input to the list */
+static bool re_add(const Regex *re, int *list, int *n, int *mark, int gen,
+                   int pc, int pos, int len)
+{
+    if (mark[pc] == gen) return false;
+    mark[pc] = gen;
+
+    const ReInst *in = &re->inst[pc];
+    switch (in->op) {
+    case RI_MATCH: return true;
+    case RI_JMP:   return re_add(re, list, n, mark, gen, in->x, pos, len);
+    case RI_SPLIT:
+        return re_add(re, list, n, mark, gen, in->x, pos, len) ||
+               re_add(re, list, n, mark, gen, in->y, pos, len);
+    case RI_BOL:
+        return pos == 0 && re_add(re, list, n, mark, gen, pc + 1, pos, len);
+    case RI_EOL:
+        return pos == len && re_add(re, list, n, mark, gen, pc + 1, pos, len);
+    default:
+        list[(*n)++] = pc;
+        return false;
+    }
+}
+
+/* true if the pattern matches anywhere in text */
+static bool re_test(const Regex *re, const char *text)
+{
+    static int lists[2][RE_MAX_INST], mark[RE_MAX_INST];
+    static int gen = 0;
+    int len = (int)strlen(text), n[2] = { 0, 0 }, cur = 0;
+
+    // a thread starts at every position: the search is unanchored
+    if (re_add(re, lists[cur], &n[cur], mark, ++gen, 0, 0, len)) return true;
+
+    for (int pos = 0; pos < len; ++pos) {
+        int c = (unsigned char)text[pos];
+        int folded = re->icase ? tolower(c) : c;
+        int nxt = !cur;
+        n[nxt] = 0;
+        ++gen;
+        for (int i = 0; i < n[cur]; ++i) {
+            const ReInst *in = &re->inst[lists[cur][i]];
+            bool ok = in->op == RI_ANY ||
+                      (in->op == RI_CHAR && in->c == folded) ||
+                      (in->op == RI_CLASS && (re->cls[in->c][c >> 3] >> (c & 7) & 1));
+            if (ok && re_add(re, lists[nxt], &n[nxt], mark, gen, lists[cur][i] + 1, pos + 1, len))
+                return true;
+        }
+        if (re_add(re, lists[nxt], &n[nxt], mark, gen, 0, pos + 1, len)) return true;
+        cur = nxt;
+    }
+    return false;
+}
+
+/* ────────────────────────────────────────────────── trigram index ── */
+
+/*
+ * Lower-cased byte trigrams of every item's text, each with a bitset of the
+ * ids containing it. A regex's required literals are ANDed through here so
+ * the matcher only runs on items that can possibly match. Items are
+ * re-indexed from todo_changed, using the trigram list kept per id to clear
+ * their old bits.
+ */
+#define TRI_WORDS ((MAX_TODOS + 63) / 64)
+
+typedef struct {
+    uint32_t key;                   /* 0: empty slot */
+    uint64_t ids[TRI_WORDS];
+} TriSlot;
+
+static TriSlot  *tri_table = NULL;
+static size_t    tri_cap = 0, tri_used = 0;
+static uint32_t *tri_keys[MAX_TODOS];      /* id -> its distinct trigrams */
+static int       tri_nkeys[MAX_TODOS];
+static bool      tri_shed_out = false;     /* dropped under memory pressure, rebuilt on next lookup */
+
+static uint32_t tri_key(const char *s)
+{
+    return (uint32_t)tolower((unsigned char)s[0]) << 16 |
+           (uint32_t)tolower((unsigned char)s[1]) << 8 |
+           (uint32_t)tolower((unsigned char)s[2]);
+}
+
+static TriSlot *tri_find(uint32_t key, bool create)
+{
+    if (create && (tri_used + 1) * 2 > tri_cap) {
+        // grow and rehash
+        size_t old_cap = tri_cap;
+        TriSlot *old = tri_table;
+        tri_cap = tri_cap ? tri_cap * 2 : 4096;
+        tri_table = calloc(tri_cap, sizeof *tri_table);
+        if (!tri_table) { perror("calloc"); exit(1); }
+        for (size_t i = 0; i < old_cap; ++i) {
+            if (!old[i].key) continue;
+            size_t j = (old[i].key * 2654435761u) & (tri_cap - 1);
+            while (tri_table[j].key) j = (j + 1) & (tri_cap - 1);
+            tri_table[j] = old[i];
+        }
+        free(old);
+    }
+    if (!tri_cap) return NULL;
+
+    size_t i = (key * 2654435761u) & (tri_cap - 1);
+    for (; tri_table[i].key; i = (i + 1) & (tri_cap - 1))
+        if (tri_table[i].key == key) return &tri_table[i];
+    if (!create) return NULL;
+    tri_table[i].key = key;
+    tri_used++;
+    return &tri_table[i];
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void tri_remove(int id)
+{
+    for (int i = 0; i < tri_nkeys[id]; ++i) {
+        TriSlot *s = tri_find(tri_keys[id][i], false);
+        if (s) s->ids[id / 64] &= ~(1ULL << (id % 64));
+    }
+    free(tri_keys[id]);
+    tri_keys[id] = NULL;
+    tri_nkeys[id] = 0;
+}
+
+static void tri_update(const Todo *t)
+{
+    if (t->id < 0 || tri_shed_out) return;
+    tri_remove(t->id);
+
+    int len = (int)strlen(t->text);
+    if (len < 3) return;
+    uint32_t *keys = malloc((size_t)(len - 2) * sizeof *keys);
+    if (!keys) return;
+
+    int n = 0;
+    for (int i = 0; i + 3 <= len; ++i) keys[n++] = tri_key(t->text + i);
+    qsort(keys, n, sizeof *keys, cmp_u32);
+    int u = 0;
+    for (int i = 0; i < n; ++i)
+        if (u == 0 || keys[u - 1] != keys[i]) keys[u++] = keys[i];
+
+    for (int i = 0; i < u; ++i)
+        tri_find(keys[i], true)->ids[t->id / 64] |= 1ULL << (t->id % 64);
+    tri_keys[t->id] = keys;
+    tri_nkeys[t->id] = u;
+}
+
+static void tri_drop(void)
+{
+    for (int id = 0; id < MAX_TODOS; ++id) {
+        free(tri_keys[id]);
+        tri_keys[id] = NULL;
+        tri_nkeys[id] = 0;
+    }
+    free(tri_table);
+    tri_table = NULL;
+    tri_cap = tri_used = 0;
+}
+
+static void tri_rebuild(void)
+{
+    tri_drop();
+    tri_shed_out = false;
+    for (int i = 0; i < todo_count; ++i)
+        tri_update(&todos[i]);
+}
+
+static size_t tri_bytes(void)
+{
+    size_t bytes = tri_cap * sizeof *tri_table;
+    for (int id = 0; id < MAX_TODOS; ++id) bytes += (size_t)tri_nkeys[id] * sizeof **tri_keys;
+    return bytes;
+}
+
+static void tri_shed(void)
+{
+    tri_drop();
+    tri_shed_out = true;
+}
+
+/* ids that contain every trigram of every literal; all ids if none given */
+static void tri_candidates(char lits[][MAX_LINE], int nlits, uint64_t *out)
+{
+    if (tri_shed_out) tri_rebuild();
+    memset(out, 0xff, TRI_WORDS * sizeof *out);
+    for (int l = 0; l < nlits; ++l) {
+        for (const char *p = lits[l]; p[0] && p[1] && p[2]; ++p) {
+            TriSlot *s = tri_find(tri_key(p), false);
+            if (!s) { memset(out, 0, TRI_WORDS * sizeof *out); return; }
+            for (int w = 0; w < TRI_WORDS; ++w) out[w] &= s->ids[w];
+        }
+    }
+}
+
+/* ───────────────────────────────────────────────────────── subtasks ── */
+
+/*
+ * An item becomes a subtask with a "parent:<key>" tag naming the "id:" tag
+ * of another item. The links form a tree index by session id. Every node
+ * keeps done/total counts of its descendants, adjusted along the ancestor
+ * chain when an item is linked, unlinked or toggled, so showing progress
+ * never walks a subtree.
+ */
+#define ITEM_KEY 16
+#define TREE_MAP (2 * MAX_TODOS)
+
+static int  tree_parent[MAX_TODOS];          /* session id of the parent, -1 */
+static int  tree_total[MAX_TODOS];           /* descendants */
+static int  tree_done[MAX_TODOS];            /* completed descendants */
+static bool tree_counted[MAX_TODOS];         /* completion as counted above */
+static bool tree_folded[MAX_TODOS];
+static char tree_key[MAX_TODOS][ITEM_KEY];   /* own "id:" value */
+static int  tree_map[TREE_MAP];              /* key -> id, -1 empty, -2 deleted */
+static int  tree_links = 0;                  /* items with a parent */
+static unsigned long tree_revision = 0;      /* bumped when folding changes */
+
+/* the value of a "tag:" word in text into out; false if absent or too long */
+static bool item_tag(const char *text, const char *tag, char *out)
+{
+    size_t tlen = strlen(tag);
+    for (const char *p = strstr(text, tag); p; p = strstr(p + 1, tag)) {
+        if ((p != text && !isspace((unsigned char)p[-1])) || p[tlen] != ':') continue;
+        size_t n = strcspn(p + tlen + 1, " \t");
+        if (n == 0 || n >= ITEM_KEY) continue;
+        memcpy(out, p + tlen + 1, n);
+        out[n] = '\0';
+        return true;
+    }
+    return false;
+}
+
+static bool item_key_of(const Todo *t, char *key)
+{
+    return item_tag(t->text, "id", key);
+}
+
+/* drop every "tag:value" word from text */
+static void remove_text_tag(char *text, const char *tag)
+{
+    size_t tlen = strlen(tag);
+    for (char *p = strstr(text, tag); p; p = strstr(p, tag)) {
+        if ((p != text && !isspace((unsigned char)p[-1])) || p[tlen] != ':') { ++p; continue; }
+        char *end = p + strcspn(p, " \t");
+        if (p != text) --p;                         // with the space before it
+        else if (*end) ++end;
+        memmove(p, end, strlen(end) + 1);
+    }
+}
+
+static int tree_slot(const char *key)
+{
+    unsigned h = 2166136261u;
+    for (const char *p = key; *p; ++p) h = (h ^ (unsigned char)*p) * 16777619u;
+    return (int)(h % TREE_MAP);
+}
+
+static int tree_lookup(const char *key)
+{
+    for (int i = tree_slot(key), n = 0; n < TREE_MAP && tree_map[i] != -1; i = (i + 1) % TREE_MAP, ++n)
+        if (tree_map[i] >= 0 && strcmp(tree_key[tree_map[i]], key) == 0) return tree_map[i];
+    return -1;
+}
+
+static void tree_map_put(int id)
+{
+    int i = tree_slot(tree_key[id]);
+    while (tree_map[i] >= 0) i = (i + 1) % TREE_MAP;
+    tree_map[i] = id;
+}
+
+static void tree_map_del(int id)
+{
+    for (int i = tree_slot(tree_key[id]), n = 0; n < TREE_MAP && tree_map[i] != -1; i = (i + 1) % TREE_MAP, ++n)
+        if (tree_map[i] == id) { tree_map[i] = -2; return; }
+}
+
+static void tree_adjust(int from, int total, int done)
+{
+    for (int p = from; p >= 0; p = tree_parent[p]) {
+        tree_total[p] += total;
+        tree_done[p] += done;
+    }
+}
+
+static void tree_detach(int id)
+{
+    int p = tree_parent[id];
+    if (p < 0) return;
+    tree_adjust(p, -(tree_total[id] + 1), -(tree_done[id] + tree_counted[id]));
+    tree_parent[id] = -1;
+    tree_links--;
+}
+
+static void tree_attach(int id, int p)
+{
+    for (int q = p; q >= 0; q = tree_parent[q])
+        if (q == id) return;                        // would be a cycle
+    tree_parent[id] = p;
+    tree_adjust(p, tree_total[id] + 1, tree_done[id] + tree_counted[id]);
+    tree_links++;
+}
+
+/* the parent t's "parent:" tag resolves to, -1 if none */
+static int tree_wanted_parent(const Todo *t)
+{
+    char want[ITEM_KEY];
+    return item_tag(t->text, "parent", want) ? tree_lookup(want) : -1;
+}
+
+static void tree_update(const Todo *t)
+{
+    int id = t->id;
+    if (id < 0) return;
+
+    char key[ITEM_KEY] = "";
+    item_key_of(t, key);
+    if (strcmp(key, tree_key[id]) != 0) {
+        // children follow the key: release those of the old one ...
+        if (tree_key[id][0]) {
+            tree_map_del(id);
+            for (int i = 0; i < todo_count; ++i)
+                if (tree_parent[todos[i].id] == id) tree_detach(todos[i].id);
+        }
+        snprintf(tree_key[id], ITEM_KEY, "%s", key);
+        // ... and adopt those waiting for the new one
+        if (key[0] && tree_lookup(key) < 0) {
+            tree_map_put(id);
+            char want[ITEM_KEY];
+            for (int i = 0; i < todo_count; ++i)
+                if (tree_parent[todos[i].id] < 0 && item_tag(todos[i].text, "parent", want) &&
+                    strcmp(want, key) == 0)
+                    tree_attach(todos[i].id, id);
+        }
+    }
+
+    if (t->completed != tree_counted[id]) {
+        tree_adjust(tree_parent[id], 0, t->completed ? 1 : -1);
+        tree_counted[id] = t->completed;
+    }
+
+    int p = tree_wanted_parent(t);
+    if (p != tree_parent[id]) {
+        tree_detach(id);
+        if (p >= 0) tree_attach(id, p);
+    }
+}
+
+static void tree_remove(int id)
+{
+    tree_detach(id);
+    for (int i = 0; i < todo_count; ++i)
+        if (tree_parent[todos[i].id] == id) tree_detach(todos[i].id);
+    if (tree_key[id][0]) tree_map_del(id);
+    tree_key[id][0] = '\0';
+    tree_total[id] = tree_done[id] = 0;
+    tree_counted[id] = tree_folded[id] = false;
+}
+
+static void tree_rebuild(void)
+{
+    for (int i = 0; i < MAX_TODOS; ++i) {
+        tree_parent[i] = -1;
+        tree_total[i] = tree_done[i] = 0;
+        tree_counted[i] = tree_folded[i] = false;
+        tree_key[i][0] = '\0';
+    }
+    for (int i = 0; i < TREE_MAP; ++i) tree_map[i] = -1;
+    tree_links = 0;
+    tree_revision++;
+
+    // all keys first, so a child may come before its parent in the file
+    for (int i = 0; i < todo_count; ++i) {
+        Todo *t = &todos[i];
+        tree_counted[t->id] = t->completed;
+        if (item_key_of(t, tree_key[t->id]) && tree_lookup(tree_key[t->id]) < 0)
+            tree_map_put(t->id);
+        else
+            tree_key[t->id][0] = '\0';
+    }
+    for (int i = 0; i < todo_count; ++i) {
+        int p = tree_wanted_parent(&todos[i]);
+        if (p >= 0) tree_attach(todos[i].id, p);
+    }
+}
+
+/* ─────────────────────────────────────────────────────── sequences ── */
+
+/*
+ * List order is kept as a sparse key per item (order_key[id]), not by the
+ * position in todos[], which is plain storage. Two forests of treaps over
+ * the keys give the order: SEQ_ALL holds every item (the @all view and the
+ * order written to disk), SEQ_CTX one tree per context. Both are augmented
+ * with subtree sizes, so "k-th visible item" and "rank of an item" are
+ * O(log n), and moving an item is swapping two keys.
+ *
+ * A context keeps its items in its own order while its slots in the file
+ * stay put: sorting a context only redistributes the keys it already owns.
+ *
+ * SEQ_ALL also sums the byte length of each item's line, which gives the
+ * file offset of any item in O(log n); moves use it to rewrite only the
+ * lines they touched (see persist_lines).
+ */
+#define ORDER_STEP (1L << 16)
+
+enum { SEQ_ALL, SEQ_CTX };
+enum { INSERT_AFTER, INSERT_TOP, INSERT_BOTTOM };
+
+typedef struct { int l, r, size; long bytes; } SeqLink;
+
+static SeqLink  seq_link[2][MAX_TODOS];
+static unsigned seq_prio[MAX_TODOS];
+static long     order_key[MAX_TODOS];
+static int      seq_ctx[MAX_TODOS];          /* id -> types[] index   */
+static int      seq_all_root = -1;
+static int      seq_ctx_root[MAX_TODOS];     /* types[] index -> root */
+static int      insert_mode  = INSERT_AFTER;
+static int      line_len[MAX_TODOS];         /* id -> bytes incl. '\n' */
+
+static int seq_size(int f, int n) { return n < 0 ? 0 : seq_link[f][n].size; }
+
+static long seq_bytes(int f, int n) { return n < 0 ? 0 : seq_link[f][n].bytes; }
+
+static void seq_pull(int f, int n)
+{
+    seq_link[f][n].size = 1 + seq_size(f, seq_link[f][n].l) + seq_size(f, seq_link[f][n].r);
+    seq_link[f][n].bytes = line_len[n] + seq_bytes(f, seq_link[f][n].l) + seq_bytes(f, seq_link[f][n].r);
+}
+
+/* a gets the keys < key, b the rest */
+static void seq_split(int f, int n, long key, int *a, int *b)
+{
+    if (n < 0) { *a = *b = -1; return; }
+    if (order_key[n] < key) {
+        seq_split(f, seq_link[f][n].r, key, &seq_link[f][n].r, b);
+        *a = n;
+    } else {
+        seq_split(f, seq_link[f][n].l, key, a, &seq_link[f][n].l);
+        *b = n;
+    }
+    seq_pull(f, n);
+}
+
+static int seq_merge(int f, int a, int b)
+{
+    if (a < 0) return b;
+    if (b < 0) return a;
+    if (seq_prio[a] > seq_prio[b]) {
+        seq_link[f][a].r = seq_merge(f, seq_link[f][a].r, b);
+        seq_pull(f, a);
+        return a;
+    }
+    seq_link[f][b].l = seq_merge(f, a, seq_link[f][b].l);
+    seq_pull(f, b);
+    return b;
+}
+
+static void seq_tree_insert(int f, int *root, int id)
+{
+    int a, b;
+    seq_link[f][id] = (SeqLink){ -1, -1, 1, line_len[id] };
+    seq_split(f, *root, order_key[id], &a, &b);
+    *root = seq_merge(f, seq_merge(f, a, id), b);
+}
+
+static void seq_tree_erase(int f, int *root, int id)
+{
+    int a, b, mid, c;
+    seq_split(f, *root, order_key[id], &a, &b);
+    seq_split(f, b, order_key[id] + 1, &mid, &c);
+    *root = seq_merge(f, a, c);
+}
+
+static int seq_tree_select(int f, int n, int k)
+{
+    while (n >= 0) {
+        int ls = seq_size(f, seq_link[f][n].l);
+        if (k < ls) n = seq_link[f][n].l;
+        else if (k == ls) return n;
+        else { k -= ls + 1; n = seq_link[f][n].r; }
+    }
+    return -1;
+}
+
+/* number of keys < key */
+static int seq_tree_rank(int f, int n, long key)
+{
+    int rank = 0;
+    while (n >= 0) {
+        if (order_key[n] < key) {
+            rank += seq_size(f, seq_link[f][n].l) + 1;
+            n = seq_link[f][n].r;
+        } else {
+            n = seq_link[f][n].l;
+        }
+    }
+    return rank;
+}
+
+static void seq_reset(void)
+{
+    seq_all_root = -1;
+    for (int i = 0; i < MAX_TODOS; ++i) seq_ctx_root[i] = -1;
+}
+
+/* byte offset of an item's line in the saved file */
+static long seq_offset(int id)
+{
+    long off = 0;
+    for (int n = seq_all_root; n >= 0; ) {
+        if (order_key[n] < order_key[id]) {
+            off += seq_bytes(SEQ_ALL, seq_link[SEQ_ALL][n].l) + line_len[n];
+            n = seq_link[SEQ_ALL][n].r;
+        } else if (order_key[n] > order_key[id]) {
+            n = seq_link[SEQ_ALL][n].l;
+        } else {
+            return off + seq_bytes(SEQ_ALL, seq_link[SEQ_ALL][n].l);
+        }
+    }
+    return off;
+}
+
+/* link an item whose order_key is set into both trees */
+static void seq_link_item(const Todo *t)
+{
+    char line[MAX_LINE * 2];
+    line_len[t->id] = format_todo_line(line, sizeof line, t);
+    seq_prio[t->id] = (unsigned)rand();
+    seq_ctx[t->id] = type_index(t->type);
+    seq_tree_insert(SEQ_ALL, &seq_all_root, t->id);
+    if (seq_ctx[t->id] >= 0)
+        seq_tree_insert(SEQ_CTX, &seq_ctx_root[seq_ctx[t->id]], t->id);
+}
+
+static void seq_unlink_item(int id)
+{
+    seq_tree_erase(SEQ_ALL, &seq_all_root, id);
+    if (seq_ctx[id] >= 0)
+        seq_tree_erase(SEQ_CTX, &seq_ctx_root[seq_ctx[id]], id);
+}
+
+static void seq_renumber_walk(int n, long *next)
+{
+    if (n < 0) return;
+    seq_renumber_walk(seq_link[SEQ_ALL][n].l, next);
+    order_key[n] = (*next += ORDER_STEP);
+    seq_renumber_walk(seq_link[SEQ_ALL][n].r, next);
+}
+
+/* spread keys out again; order is unchanged so the trees stay valid */
+static void seq_renumber(void)
+{
+    long next = 0;
+    seq_renumber_walk(seq_all_root, &next);
+}
+
+/* a free key right after (or, with before, right before) item id in @all */
+static long seq_key_next_to(int id, bool before)
+{
+    int g = seq_tree_rank(SEQ_ALL, seq_all_root, order_key[id]);
+    int other = seq_tree_select(SEQ_ALL, seq_all_root, before ? g - 1 : g + 1);
+    long lo = before ? (other >= 0 ? order_key[other] : order_key[id] - 2 * ORDER_STEP) : order_key[id];
+    long hi = before ? order_key[id] : (other >= 0 ? order_key[other] : order_key[id] + 2 * ORDER_STEP);
+
+    if (hi - lo < 2) {
+        seq_renumber();
+        return seq_key_next_to(id, before);
+    }
+    return lo + (hi - lo) / 2;
+}
+
+/* ── the current view (context or @all) ── */
+
+static int view_root(int *forest)
+{
+    if (strcmp(types[selected_type], "all") == 0) {
+        *forest = SEQ_ALL;
+        return seq_all_root;
+    }
+    *forest = SEQ_CTX;
+    return seq_ctx_root[selected_type];
+}
+
+static void seq_collect(int f, int n, Todo **out, int *count)
+{
+    if (n < 0) return;
+    seq_collect(f, seq_link[f][n].l, out, count);
+    out[(*count)++] = todo_by_id(n);
+    seq_collect(f, seq_link[f][n].r, out, count);
+}
+
+/* the current view's items in order, returns how many */
+static int view_collect(Todo **out)
+{
+    int f, root = view_root(&f), count = 0;
+    seq_collect(f, root, out, &count);
+    return count;
+}
+
+/*
+ * With a regex filter set (`/`), the view is the matching items of the
+ * context in order. The list is rebuilt when the store or the context
+ * changed since it was made: trigram candidates first, then the matcher.
+ */
+static bool          filter_on = false;
+static Regex         filter_re;
+static char          filter_src[MAX_LINE];
+static int           filter_ids[MAX_TODOS];
+static int           filter_n = 0;
+static unsigned long filter_rev = 0;
+static int           filter_ctx = -1;
+
+static int cmp_order(const void *a, const void *b)
+{
+    long x = order_key[*(const int *)a], y = order_key[*(const int *)b];
+    return (x > y) - (x < y);
+}
+
+static void filter_refresh(void)
+{
+    if (filter_rev == store_revision && filter_ctx == selected_type) return;
+    filter_rev = store_revision;
+    filter_ctx = selected_type;
+
+    uint64_t cand[TRI_WORDS];
+    tri_candidates(filter_re.lits, filter_re.nlits, cand);
+
+    bool all = strcmp(types[selected_type], "all") == 0;
+    filter_n = 0;
+    for (int w = 0; w < TRI_WORDS; ++w) {
+        for (uint64_t bits = cand[w]; bits; bits &= bits - 1) {
+            Todo *t = todo_by_id(w * 64 + __builtin_ctzll(bits));
+            if (!t || (!all && type_index(t->type) != selected_type)) continue;
+            if (re_test(&filter_re, t->text)) filter_ids[filter_n++] = t->id;
+        }
+    }
+    qsort(filter_ids, filter_n, sizeof *filter_ids, cmp_order);
+}
+
+/* set the filter; an empty pattern clears it. NULL or an error message */
+static const char *set_filter(const char *pattern)
+{
+    filter_on = false;
+    filter_ctx = -1;
+    if (!pattern[0]) return NULL;
+    const char *err = re_compile(&filter_re, pattern);
+    if (err) return err;
+    snprintf(filter_src, sizeof filter_src, "%s", pattern);
+    filter_on = true;
+    return NULL;
+}
+
+/*
+ * Once any item has a parent, the unfiltered view lists the context as an
+ * outline: each item followed by its children (in order), depth-first.
+ * Folded items contribute themselves but none of their subtree, so hidden
+ * rows cost nothing when drawing. Rebuilt like the filter list, when the
+ * store, the context or a fold changed.
+ */
+static int           outline_ids[MAX_TODOS];
+static int           outline_depth[MAX_TODOS];
+static int           outline_pos[MAX_TODOS];    /* id -> row, -1 if hidden */
+static int           outline_n = 0;
+static unsigned long outline_rev = 0, outline_fold = 0;
+static int           outline_ctx = -1;
+
+static bool outline_on(void)
+{
+    return tree_links > 0 && !filter_on;
+}
+
+static void outline_refresh(void)
+{
+    if (outline_rev == store_revision && outline_ctx == selected_type &&
+        outline_fold == tree_revision) return;
+    outline_rev = store_revision;
+    outline_ctx = selected_type;
+    outline_fold = tree_revision;
+
+    static Todo *items[MAX_TODOS];
+    static int first_child[MAX_TODOS], last_child[MAX_TODOS], next_sib[MAX_TODOS];
+    int f, root = view_root(&f), n = 0;
+    seq_collect(f, root, items, &n);
+
+    for (int i = 0; i < MAX_TODOS; ++i) outline_pos[i] = -2;
+    for (int i = 0; i < n; ++i) {
+        int id = items[i]->id;
+        outline_pos[id] = -1;                       // in this view
+        first_child[id] = last_child[id] = next_sib[id] = -1;
+    }
+
+    // children lists in view order; items whose parent is elsewhere are roots
+    int first_root = -1, last_root = -1;
+    for (int i = 0; i < n; ++i) {
+        int id = items[i]->id, p = tree_parent[id];
+        int *first = &first_root, *last = &last_root;
+        if (p >= 0 && outline_pos[p] == -1) { first = &first_child[p]; last = &last_child[p]; }
+        if (*last < 0) *first = id; else next_sib[*last] = id;
+        *last = id;
+    }
+
+    // iterative pre-order walk, the stack holds the open ancestors
+    static int stack[MAX_TODOS];
+    int sp = 0;
+    outline_n = 0;
+    for (int id = first_root; id >= 0; ) {
+        outline_pos[id] = outline_n;
+        outline_depth[outline_n] = sp;
+        outline_ids[outline_n++] = id;
+
+        if (first_child[id] >= 0 && !tree_folded[id]) {
+            stack[sp++] = id;
+            id = first_child[id];
+            continue;
+        }
+        while (next_sib[id] < 0 && sp > 0) id = stack[--sp];
+        id = next_sib[id];
+    }
+}
+
+/* indentation level of row k */
+static int view_depth(int k)
+{
+    if (!outline_on()) return 0;
+    outline_refresh();
+    return k >= 0 && k < outline_n ? outline_depth[k] : 0;
+}
+
+static int view_count(void)
+{
+    if (filter_on) { filter_refresh(); return filter_n; }
+    if (outline_on()) { outline_refresh(); return outline_n; }
+    int f, root = view_root(&f);
+    return seq_size(f, root);
+}
+
+static Todo *view_at(int k)
+{
+    if (filter_on) {
+        filter_refresh();
+        return k >= 0 && k < filter_n ? todo_by_id(filter_ids[k]) : NULL;
+    }
+    if (outline_on()) {
+        outline_refresh();
+        return k >= 0 && k < outline_n ? todo_by_id(outline_ids[k]) : NULL;
+    }
+    int f, root = view_root(&f);
+    if (k < 0 || k >= seq_size(f, root)) return NULL;
+    return todo_by_id(seq_tree_select(f, root, k));
+}
+
+static int view_rank(const Todo *t)
+{
+    if (filter_on) {
+        // the list is in order_key order, so binary search it
+        filter_refresh();
+        int lo = 0, hi = filter_n;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (order_key[filter_ids[mid]] < order_key[t->id]) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+    if (outline_on()) {
+        // a row hidden by a fold resolves to the folded ancestor
+        outline_refresh();
+        int id = t->id;
+        while (outline_pos[id] == -1 && tree_parent[id] >= 0) id = tree_parent[id];
+        return outline_pos[id] >= 0 ? outline_pos[id] : outline_n;
+    }
+    int f, root = view_root(&f);
+    return seq_tree_rank(f, root, order_key[t->id]);
+}
+
+/*
+ * The selection follows the item, not the row: operations that reorder or
+ * rebuild the view remember the selected id first and look its new rank up
+ * in the order tree afterwards.
+ */
+static int selected_id(void)
+{
+    Todo *t = view_at(selected_index);
+    return t ? t->id : -1;
+}
+
+static void center_selection(void)
+{
+    int visible = LINES - 2, n = view_count();
+    scroll_offset = selected_index - visible / 2;
+    if (scroll_offset > n - visible) scroll_offset = n - visible;
+    if (scroll_offset < 0) scroll_offset = 0;
+}
+
+/* select id if it is in the current view, else stay on the same row */
+static void restore_selection(int id)
+{
+    Todo *t = todo_by_id(id);
+    int n = view_count();
+    if (t && view_at(view_rank(t)) == t)
+        selected_index = view_rank(t);
+    else if (selected_index >= n)
+        selected_index = n > 0 ? n - 1 : 0;
+    center_selection();
+}
+
+/* show context ctx, keeping the selected item if it is there too */
+static void switch_context(int ctx)
+{
+    int sel = selected_id();
+    selected_type = ctx;
+    selected_index = 0;
+    restore_selection(sel);
+}
+
+/*
+ * Give t (already stored, not linked) a key that places it in context ctx
+ * according to insert_mode; `after` is the selected item for INSERT_AFTER.
+ */
+static void seq_place(Todo *t, const Todo *after)
+{
+    // an item without context goes to the top/bottom of the whole list
+    int ctx = type_index(t->type);
+    int f = (ctx <= 0) ? SEQ_ALL : SEQ_CTX;
+    int root = (ctx <= 0) ? seq_all_root : seq_ctx_root[ctx];
+    int n = seq_size(f, root);
+
+    if (insert_mode == INSERT_AFTER && after)
+        order_key[t->id] = seq_key_next_to(after->id, false);
+    else if (insert_mode == INSERT_TOP && n > 0)
+        order_key[t->id] = seq_key_next_to(seq_tree_select(f, root, 0), true);
+    else if (n > 0)
+        order_key[t->id] = seq_key_next_to(seq_tree_select(f, root, n - 1), false);
+    else {
+        int last = seq_tree_select(SEQ_ALL, seq_all_root, seq_size(SEQ_ALL, seq_all_root) - 1);
+        order_key[t->id] = (last >= 0 ? order_key[last] : 0) + ORDER_STEP;
+    }
+    seq_link_item(t);
+}
+
+/* swap the list positions of two items */
+static void seq_swap(Todo *a, Todo *b)
+{
+    seq_unlink_item(a->id);
+    seq_unlink_item(b->id);
+    long k = order_key[a->id];
+    order_key[a->id] = order_key[b->id];
+    order_key[b->id] = k;
+    seq_link_item(a);
+    seq_link_item(b);
+    store_revision++;
+}
+
+/*
+ * Reorder the given items (listed in their current order) into the order
+ * of sorted[], reusing their keys so the slots they occupy don't change.
+ */
+static void seq_reassign(Todo **current, Todo **sorted, int n)
+{
+    static long keys[MAX_TODOS];
+    for (int i = 0; i < n; ++i) {
+        keys[i] = order_key[current[i]->id];
+        seq_unlink_item(current[i]->id);
+    }
+    for (int i = 0; i < n; ++i) {
+        order_key[sorted[i]->id] = keys[i];
+        seq_link_item(sorted[i]);
+    }
+    store_revision++;
+}
+
+static void seq_walk(int n, void (*fn)(Todo *, void *), void *arg)
+{
+    if (n < 0) return;
+    seq_walk(seq_link[SEQ_ALL][n].l, fn, arg);
+    fn(todo_by_id(n), arg);
+    seq_walk(seq_link[SEQ_ALL][n].r, fn, arg);
+}
+
+/* every item in list (file) order */
+static void for_each_todo(void (*fn)(Todo *, void *), void *arg)
+{
+    seq_walk(seq_all_root, fn, arg);
+}
+
+/* Every in‑place edit of an item goes through here. */
+static void todo_changed(Todo *t)
+{
+    // line lengths feed the file offsets kept in SEQ_ALL
+    char line[MAX_LINE * 2];
+    if (format_todo_line(line, sizeof line, t) != line_len[t->id]) {
+        seq_unlink_item(t->id);
+        seq_link_item(t);
+    }
+    next_update(t);
+    esc_update(t);
+    tags_update(t);
+    tri_update(t);
+    tree_update(t);
+    row_version[t->id]++;
+    store_revision++;
+}
+
+/* Items leaving the store (archive) go through here. */
+static void todo_removed(Todo *t)
+{
+    seq_unlink_item(t->id);
+    ih_remove(&next_heap, t->id);
+    ih_remove(&esc_heap, t->id);
+    tags_remove(t->id);
+    tri_remove(t->id);
+    tree_remove(t->id);
+    free_id(t->id);
+    store_revision++;
+}
+
+/* ────────────────────────────────────────────────────── encryption ── */
+
+/*
+ * With --encrypt (in a `make CRYPTO=1` build) the todo file and its
+ * archive are kept as sealed containers:
+ *
+ *     header   magic, scrypt parameters and salt, file id, chunk count and
+ *              text length, sealed together with a hash of every chunk tag
+ *     chunks   CRYPT_SLOT bytes each: nonce, AES-256-GCM ciphertext, tag
+ *
+ * A chunk holds whole lines plus padding and ends after a line whose hash
+ * says so, so an edit changes the chunk around it while the others keep
+ * their text. A save seals only chunks whose text was not in the previous
+ * version and copies the rest as they were; a load opens the chunks on the
+ * thread pool. Since the header covers the chunk tags, chunks cannot be
+ * dropped, reordered or swapped for older ones.
+ *
+ * Everything else reads through store_open() and writes through
+ * store_create()/store_commit(), which are plain stdio while the files
+ * are not sealed.
+ */
+#define CRYPT_MAGIC  "NNTMENC1"
+#define CRYPT_HEADER 80
+#define CRYPT_SLOT   4096
+#define CRYPT_DATA   (CRYPT_SLOT - 12 - 16 - 2)    /* text per chunk */
+
+static bool crypt_on = false;                      /* seal files on write */
+static char crypt_pass[256];
+
+/* the header starts with the magic */
+static bool crypt_sealed(const char *path)
+{
+    char magic[8];
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    bool sealed = read(fd, magic, 8) == 8 && memcmp(magic, CRYPT_MAGIC, 8) == 0;
+    close(fd);
+    return sealed;
+}
+
+/* NNTM_PASSPHRASE, or asked for on the terminal; twice for a new one */
+static void crypt_read_passphrase(const char *path, bool confirm)
+{
+    const char *env = getenv("NNTM_PASSPHRASE");
+    if (env) { snprintf(crypt_pass, sizeof crypt_pass, "%s", env); return; }
+
+    FILE *tty = fopen("/dev/tty", "r+");
+    if (!tty) { fprintf(stderr, "%s: no terminal to ask for the passphrase\n", path); exit(1); }
+    struct termios old, quiet;
+    tcgetattr(fileno(tty), &old);
+    quiet = old;
+    quiet.c_lflag &= ~(tcflag_t)ECHO;
+    tcsetattr(fileno(tty), TCSAFLUSH, &quiet);
+
+    char again[sizeof crypt_pass];
+    for (;;) {
+        fprintf(tty, "%s for %s: ", confirm ? "New passphrase" : "Passphrase", path);
+        if (!fgets(crypt_pass, sizeof crypt_pass, tty)) crypt_pass[0] = '\0';
+        crypt_pass[strcspn(crypt_pass, "\n")] = '\0';
+        fprintf(tty, "\n");
+        if (!confirm) break;
+        fprintf(tty, "Repeat: ");
+        if (!fgets(again, sizeof again, tty)) again[0] = '\0';
+        again[strcspn(again, "\n")] = '\0';
+        fprintf(tty, "\n");
+        if (crypt_pass[0] && strcmp(again, crypt_pass) == 0) break;
+        fprintf(tty, "Passphrases differ or are empty.\n");
+    }
+    tcsetattr(fileno(tty), TCSAFLUSH, &old);
+    fclose(tty);
+}
+
+#ifdef NNTM_CRYPTO
+
+/* a sealed file as last read or written */
+typedef struct {
+    char           path[PATH_MAX];
+    struct stat    st;
+    unsigned char  params[4], salt[16], id[16], key[32];
+    char          *text;                /* the whole plaintext */
+    size_t         len;
+    int            n;
+    size_t        *off;                 /* chunk i is text[off[i] .. off[i + 1]) */
+    uint64_t      *hash;
+    unsigned char *sealed;              /* n slots */
+} CryptFile;
+
+static CryptFile crypt_files[2];        /* the todo file and the archive */
+
+static struct { unsigned char salt[16], key[32]; bool set; } crypt_keys[4];
+
+/* scrypt, once per salt */
+static bool crypt_key(const unsigned char *params, const unsigned char *salt, unsigned char *key)
+{
+    for (int i = 0; i < 4; ++i)
+        if (crypt_keys[i].set && memcmp(crypt_keys[i].salt, salt, 16) == 0) {
+            memcpy(key, crypt_keys[i].key, 32);
+            return true;
+        }
+    if (params[0] > 24 || !EVP_PBE_scrypt(crypt_pass, strlen(crypt_pass), salt, 16,
+                                          1ULL << params[0], params[1], params[2],
+                                          1ULL << 30, key, 32))
+        return false;
+    static int next = 0;
+    memcpy(crypt_keys[next].salt, salt, 16);
+    memcpy(crypt_keys[next].key, key, 32);
+    crypt_keys[next].set = true;
+    next = (next + 1) % 4;
+    return true;
+}
+
+/* AES-256-GCM; open checks tag and returns false on any mismatch */
+static bool crypt_aead(bool seal, const unsigned char *key, const unsigned char *nonce,
+                       const unsigned char *aad, int aadlen,
+                       const unsigned char *in, int len, unsigned char *out, unsigned char *tag)
+{
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    unsigned char none[16];
+    int n = 0;
+    if (!out) out = none;
+    bool ok = ctx && EVP_CipherInit_ex(ctx, EVP_aes_256_gcm(), NULL, key, nonce, seal) &&
+              EVP_CipherUpdate(ctx, NULL, &n, aad, aadlen) &&
+              (len == 0 || EVP_CipherUpdate(ctx, out, &n, in, len)) &&
+              (seal || EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, 16, tag)) &&
+              EVP_CipherFinal_ex(ctx, out + (len ? n : 0), &n) &&
+              (!seal || EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, 16, tag));
+    EVP_CIPHER_CTX_free(ctx);
+    return ok;
+}
+
+/* the header's own tag covers its fields and every chunk tag, in order */
+static bool crypt_header(bool seal, unsigned char *hdr, const unsigned char *key,
+                         const unsigned char *sealed, int n)
+{
+    unsigned char aad[52 + 32];
+    unsigned int dlen = 0;
+    EVP_MD_CTX *md = EVP_MD_CTX_new();
+    bool ok = md && EVP_DigestInit_ex(md, EVP_sha256(), NULL);
+    for (int i = 0; ok && i < n; ++i)
+        ok = EVP_DigestUpdate(md, sealed + (size_t)i * CRYPT_SLOT + CRYPT_SLOT - 16, 16);
+    ok = ok && EVP_DigestFinal_ex(md, aad + 52, &dlen);
+    EVP_MD_CTX_free(md);
+    memcpy(aad, hdr, 52);
+    return ok && crypt_aead(seal, key, hdr + 52, aad, sizeof aad, NULL, 0, NULL, hdr + 64);
+}
+
+/* work for the pool: open or seal the chunks listed in todo */
+static struct {
+    const unsigned char *key, *id;
+    unsigned char       *slots, *plain;     /* plain: CRYPT_SLOT per chunk */
+    const int           *todo;
+    int                  n, next;
+    bool                 seal, failed;
+} crypt_job;
+
+static void *crypt_worker(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        int j = __atomic_fetch_add(&crypt_job.next, 1, __ATOMIC_RELAXED);
+        if (j >= crypt_job.n) return NULL;
+        int i = crypt_job.todo ? crypt_job.todo[j] : j;
+        unsigned char *slot = crypt_job.slots + (size_t)i * CRYPT_SLOT;
+        unsigned char *plain = crypt_job.plain + (size_t)i * CRYPT_SLOT;
+        bool ok = crypt_job.seal
+            ? RAND_bytes(slot, 12) == 1 &&
+              crypt_aead(true, crypt_job.key, slot, crypt_job.id, 16, plain, CRYPT_SLOT - 28,
+                         slot + 12, slot + CRYPT_SLOT - 16)
+            : crypt_aead(false, crypt_job.key, slot, crypt_job.id, 16, slot + 12, CRYPT_SLOT - 28,
+                         plain, slot + CRYPT_SLOT - 16);
+        if (!ok) __atomic_store_n(&crypt_job.failed, true, __ATOMIC_RELAXED);
+    }
+}
+
+static void crypt_run(const unsigned char *key, const unsigned char *id, unsigned char *slots,
+                      unsigned char *plain, const int *todo, int n, bool seal)
+{
+    crypt_job.key = key;
+    crypt_job.id = id;
+    crypt_job.slots = slots;
+    crypt_job.plain = plain;
+    crypt_job.todo = todo;
+    crypt_job.n = n;
+    crypt_job.next = 0;
+    crypt_job.seal = seal;
+    crypt_job.failed = false;
+    run_pool(crypt_worker, n);
+}
+
+static void crypt_free(CryptFile *cf)
+{
+    free(cf->text);
+    free(cf->off);
+    free(cf->hash);
+    free(cf->sealed);
+    memset(cf, 0, sizeof *cf);
+}
+
+/* the cache entry for path, a free or reused one if it has none */
+static CryptFile *crypt_file(const char *path)
+{
+    for (int i = 0; i < 2; ++i)
+        if (strcmp(crypt_files[i].path, path) == 0) return &crypt_files[i];
+    CryptFile *cf = !crypt_files[0].path[0] ? &crypt_files[0] : &crypt_files[1];
+    crypt_free(cf);
+    snprintf(cf->path, sizeof cf->path, "%s", path);
+    return cf;
+}
+
+static bool crypt_same_file(const struct stat *a, const struct stat *b)
+{
+    return a->st_ino == b->st_ino && a->st_size == b->st_size &&
+           a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+/* read and open a sealed file, or reuse the cached text if it has not changed */
+static CryptFile *crypt_load(const char *path)
+{
+    CryptFile *cf = crypt_file(path);
+    struct stat st;
+    if (stat(path, &st) != 0) return NULL;
+    if (cf->sealed && crypt_same_file(&st, &cf->st)) return cf;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    size_t size = (size_t)st.st_size;
+    unsigned char *buf = malloc(size ? size : 1);
+    size_t got = 0;
+    for (ssize_t r; buf && got < size && (r = read(fd, buf + got, size - got)) > 0; )
+        got += (size_t)r;
+    close(fd);
+
+    unsigned char hdr[CRYPT_HEADER], key[32], *plain = NULL;
+    int n = -1;
+    const char *err = "not a sealed todo file";
+    if (buf && got == size && size >= CRYPT_HEADER && memcmp(buf, CRYPT_MAGIC, 8) == 0) {
+        memcpy(hdr, buf, CRYPT_HEADER);
+        n = (int)(hdr[44] | hdr[45] << 8 | hdr[46] << 16 | (uint32_t)hdr[47] << 24);
+        if ((size - CRYPT_HEADER) % CRYPT_SLOT != 0 || (size - CRYPT_HEADER) / CRYPT_SLOT != (size_t)n) n = -1;
+    }
+    if (n >= 0) {
+        err = "wrong passphrase or damaged file";
+        if (!crypt_key(hdr + 8, hdr + 12, key) ||
+            !crypt_header(false, hdr, key, buf + CRYPT_HEADER, n)) n = -1;
+    }
+    if (n >= 0) {
+        plain = malloc((size_t)n * CRYPT_SLOT + 1);
+        crypt_run(key, hdr + 28, buf + CRYPT_HEADER, plain, NULL, n, false);
+        if (crypt_job.failed) n = -1;
+    }
+    if (n < 0) {
+        fprintf(stderr, "%s: %s\n", path, err);
+        free(buf);
+        free(plain);
+        return NULL;
+    }
+
+    // drop the padding: the chunk texts end to end
+    crypt_free(cf);
+    snprintf(cf->path, sizeof cf->path, "%s", path);
+    cf->off = malloc(((size_t)n + 1) * sizeof *cf->off);
+    cf->hash = malloc(((size_t)n + 1) * sizeof *cf->hash);
+    size_t len = 0;
+    for (int i = 0; i < n; ++i) {
+        const unsigned char *c = plain + (size_t)i * CRYPT_SLOT;
+        size_t used = c[0] | (size_t)c[1] << 8;
+        if (used > CRYPT_DATA) used = 0;
+        memmove(plain + len, c + 2, used);
+        cf->off[i] = len;
+        cf->hash[i] = hash64((char *)plain + len, used);
+        len += used;
+    }
+    cf->off[n] = len;
+    cf->text = (char *)plain;
+    cf->len = len;
+    cf->n = n;
+    cf->sealed = memmove(buf, buf + CRYPT_HEADER, size - CRYPT_HEADER);
+    memcpy(cf->params, hdr + 8, 4);
+    memcpy(cf->salt, hdr + 12, 16);
+    memcpy(cf->id, hdr + 28, 16);
+    memcpy(cf->key, key, 32);
+    cf->st = st;
+    return cf;
+}
+
+/* chunk boundaries: whole lines, cut after a line whose hash ends in 0000 */
+static size_t crypt_chunk_end(const char *text, size_t start, size_t len)
+{
+    size_t end = start;
+    while (end < len) {
+        const char *nl = memchr(text + end, '\n', len - end);
+        size_t next = nl ? (size_t)(nl - text) + 1 : len;
+        if (next - start > CRYPT_DATA) return end > start ? end : start + CRYPT_DATA;
+        bool cut = (hash64(text + end, next - end) & 15) == 0;
+        end = next;
+        if (cut) break;
+    }
+    return end;
+}
+
+/* write text to path sealed, through a temp file and a rename */
+static bool crypt_save(const char *path, const char *text, size_t len)
+{
+    CryptFile *cf = crypt_file(path);
+    CryptFile *other = cf == &crypt_files[0] ? &crypt_files[1] : &crypt_files[0];
+    if (!cf->sealed && crypt_sealed(path)) crypt_load(path);   // shed: keep its salt and unchanged chunks
+    if (!cf->sealed) {
+        // a new container: the other file's key if it has one, else a new salt
+        memcpy(cf->params, (unsigned char[4]){ 15, 8, 1, 0 }, 4);
+        if (other->sealed) {
+            memcpy(cf->params, other->params, 4);
+            memcpy(cf->salt, other->salt, 16);
+        } else if (RAND_bytes(cf->salt, 16) != 1) {
+            return false;
+        }
+        if (RAND_bytes(cf->id, 16) != 1 || !crypt_key(cf->params, cf->salt, cf->key)) return false;
+    }
+
+    int n = 0, cap = 16, dirty = 0;
+    size_t *off = malloc((size_t)(cap + 1) * sizeof *off);
+    for (size_t at = 0; at < len; at = off[n]) {
+        if (n == cap) {
+            cap *= 2;
+            off = realloc(off, (size_t)(cap + 1) * sizeof *off);
+        }
+        off[n++] = at;
+        off[n] = crypt_chunk_end(text, at, len);
+    }
+    if (n == 0) off[0] = 0;
+
+    // old chunks by text, so unchanged ones are copied still sealed
+    int map_size = 2 * cf->n + 1, *map = malloc((size_t)map_size * sizeof *map);
+    for (int i = 0; i < map_size; ++i) map[i] = -1;
+    for (int i = 0; i < cf->n; ++i) {
+        int k = (int)(cf->hash[i] % (uint64_t)map_size);
+        while (map[k] >= 0) k = (k + 1) % map_size;
+        map[k] = i;
+    }
+
+    unsigned char *sealed = malloc((size_t)(n ? n : 1) * CRYPT_SLOT);
+    unsigned char *plain = calloc((size_t)(n ? n : 1), CRYPT_SLOT);
+    uint64_t *hash = malloc(((size_t)n + 1) * sizeof *hash);
+    int *todo_list = malloc((size_t)(n ? n : 1) * sizeof *todo_list);
+    for (int i = 0; i < n; ++i) {
+        size_t clen = off[i + 1] - off[i];
+        hash[i] = hash64(text + off[i], clen);
+        int old = -1;
+        for (int k = (int)(hash[i] % (uint64_t)map_size); map[k] >= 0; k = (k + 1) % map_size) {
+            int o = map[k];
+            if (cf->hash[o] == hash[i] && cf->off[o + 1] - cf->off[o] == clen &&
+                memcmp(cf->text + cf->off[o], text + off[i], clen) == 0) { old = o; break; }
+        }
+        if (old >= 0) {
+            memcpy(sealed + (size_t)i * CRYPT_SLOT, cf->sealed + (size_t)old * CRYPT_SLOT, CRYPT_SLOT);
+            continue;
+        }
+        unsigned char *c = plain + (size_t)i * CRYPT_SLOT;
+        c[0] = (unsigned char)clen;
+        c[1] = (unsigned char)(clen >> 8);
+        memcpy(c + 2, text + off[i], clen);
+        todo_list[dirty++] = i;
+    }
+    crypt_run(cf->key, cf->id, sealed, plain, todo_list, dirty, true);
+    bool ok = !crypt_job.failed;
+    free(map);
+    free(plain);
+    free(todo_list);
+
+    unsigned char hdr[CRYPT_HEADER] = CRYPT_MAGIC;
+    memcpy(hdr + 8, cf->params, 4);
+    memcpy(hdr + 12, cf->salt, 16);
+    memcpy(hdr + 28, cf->id, 16);
+    for (int b = 0; b < 4; ++b) {
+        hdr[44 + b] = (unsigned char)((unsigned)n >> (8 * b));
+        hdr[48 + b] = (unsigned char)((uint32_t)len >> (8 * b));
+    }
+    ok = ok && RAND_bytes(hdr + 52, 12) == 1 && crypt_header(true, hdr, cf->key, sealed, n);
+
+    Replace r;
+    ok = ok && replace_open(&r, path, ".crypt.tmp");
+    if (ok) {
+        ok = fwrite(hdr, 1, CRYPT_HEADER, r.f) == CRYPT_HEADER &&
+             fwrite(sealed, CRYPT_SLOT, (size_t)n, r.f) == (size_t)n;
+        if (ok) ok = replace_commit(&r);
+        else replace_abort(&r);
+    }
+    if (!ok) {
+        perror(path);
+        free(off);
+        free(hash);
+        free(sealed);
+        return false;
+    }
+
+    free(cf->text);
+    free(cf->off);
+    free(cf->hash);
+    free(cf->sealed);
+    cf->text = malloc(len + 1);
+    memcpy(cf->text, text, len);
+    cf->len = len;
+    cf->n = n;
+    cf->off = off;
+    cf->hash = hash;
+    cf->sealed = sealed;
+    stat(path, &cf->st);
+    return true;
+}
+
+static size_t crypt_bytes(void)
+{
+    size_t bytes = 0;
+    for (int i = 0; i < 2; ++i)
+        if (crypt_files[i].sealed)
+            bytes += crypt_files[i].len + (size_t)crypt_files[i].n * (CRYPT_SLOT + sizeof(size_t) + sizeof(uint64_t));
+    return bytes;
+}
+
+/* drop the opened texts; keys stay, so reading them again costs no scrypt */
+static void crypt_shed(void)
+{
+    for (int i = 0; i < 2; ++i) crypt_free(&crypt_files[i]);
+}
+
+#else
+
+static bool crypt_save(const char *path, const char *text, size_t len)
+{
+    (void)text; (void)len;
+    fprintf(stderr, "%s: built without encryption (make CRYPTO=1)\n", path);
+    return false;
+}
+
+static size_t crypt_bytes(void) { return 0; }
+static void crypt_shed(void) { }
+
+#endif
+
+/* a todo or archive file for reading; sealed ones are opened first */
+static FILE *store_open(const char *path)
+{
+    if (!crypt_sealed(path)) return fopen(path, "r");
+#ifdef NNTM_CRYPTO
+    CryptFile *cf = crypt_load(path);
+    if (!cf) { errno = EBADMSG; return NULL; }
+    return cf->len ? fmemopen(cf->text, cf->len, "r") : fopen("/dev/null", "r");
+#else
+    fprintf(stderr, "%s: encrypted, but built without encryption (make CRYPTO=1)\n", path);
+    return NULL;
+#endif
+}
+
+static struct { FILE *f; char *buf; size_t len; } store_pending;
+
+/* a todo or archive file for writing, to be finished with store_commit */
+static FILE *store_create(const char *path, bool append)
+{
+    if (!crypt_on) return fopen(path, append ? "a" : "w");
+
+    store_pending.f = open_memstream(&store_pending.buf, &store_pending.len);
+    FILE *old = append && store_pending.f ? store_open(path) : NULL;
+    if (old) {
+        char buf[1 << 16];
+        for (size_t n; (n = fread(buf, 1, sizeof buf, old)) > 0; )
+            fwrite(buf, 1, n, store_pending.f);
+        fclose(old);
+    }
+    return store_pending.f;
+}
+
+static bool store_commit(FILE *f, const char *path)
+{
+    if (!f || f != store_pending.f) return f && fclose(f) == 0;
+    bool ok = fclose(f) == 0 && crypt_save(path, store_pending.buf, store_pending.len);
+    free(store_pending.buf);
+    store_pending.f = NULL;
+    store_pending.buf = NULL;
+    return ok;
+}
+
+/*
+ * --encrypt / --decrypt: mode 1 seals the files, 0 writes them in the
+ * clear, -1 leaves them as they are. Asks for the passphrase if needed.
+ */
+static void crypt_start(int mode)
+{
+    sidecar_path(archive_path, sizeof archive_path, "todo.archive.txt");
+    bool sealed = crypt_sealed(todo_filename) || crypt_sealed(archive_path);
+    crypt_on = mode < 0 ? sealed : mode == 1;
+    if (!sealed && !crypt_on) return;
+#ifndef NNTM_CRYPTO
+    fprintf(stderr, "%s: encryption needs a build with `make CRYPTO=1`\n", todo_filename);
+    exit(1);
+#endif
+    crypt_read_passphrase(todo_filename, !sealed);
+}
+
+/* after loading: bring the files to the form asked for */
+static void crypt_convert(void)
+{
+    if (crypt_sealed(todo_filename) != crypt_on) save_todos_to_file();
+
+    struct stat st;
+    if (stat(archive_path, &st) != 0 || crypt_sealed(archive_path) == crypt_on) return;
+    FILE *in = store_open(archive_path);
+    if (!in) return;
+    char *text = NULL;
+    size_t len = 0;
+    FILE *mem = open_memstream(&text, &len);
+    char buf[1 << 16];
+    for (size_t n; (n = fread(buf, 1, sizeof buf, in)) > 0; ) fwrite(buf, 1, n, mem);
+    fclose(in);
+    fclose(mem);
+
+    FILE *out = store_create(archive_path, false);
+    if (out) fwrite(text, 1, len, out);
+    if (!store_commit(out, archive_path)) perror(archive_path);
+    free(text);
+}
+
+/* ────────────────────────────────────────────────────── completion ── */
+
+/*
+ * Prefix index over every todo text seen (live + archive). Each distinct
+ * text is stored once with a use count and a recency stamp; each trie node
+ * remembers the best text below it, so a lookup is one walk down the typed
+ * prefix. Depth is capped to keep the node pool small for big archives.
+ */
+#define COMP_DEPTH 48
+
+typedef struct {
+    char     *text;
+    int       count;
+    unsigned  last;                 /* stamp of the most recent use */
+} CompText;
+
+typedef struct {
+    int  child, sibling;
+    int  best;                      /* index into comp_texts */
+    char c;
+} CompNode;
+
+static CompText *comp_texts;
+static int       comp_text_count, comp_text_cap;
+static CompNode *comp_nodes;
+static int       comp_node_count, comp_node_cap;
+static int      *comp_hash;         /* open addressing, text -> index */
+static int       comp_hash_cap;
+static unsigned  comp_stamp;
+static bool      comp_shed_out = false;   /* dropped under memory pressure, rebuilt on next lookup */
+
+static unsigned long hash_str(const char *s)
+{
+    unsigned long h = 1469598103934665603UL;
+    while (*s) { h ^= (unsigned char)*s++; h *= 1099511628211UL; }
+    return h;
+}
+
+static bool comp_better(int a, int b)
+{
+    if (b < 0) return true;
+    if (comp_texts[a].count != comp_texts[b].count)
+        return comp_texts[a].count > comp_texts[b].count;
+    return comp_texts[a].last > comp_texts[b].last;
+}
+
+static int comp_new_node(char c)
+{
+    if (comp_node_count == comp_node_cap) {
+        comp_node_cap = comp_node_cap ? comp_node_cap * 2 : 1024;
+        comp_nodes = realloc(comp_nodes, comp_node_cap * sizeof *comp_nodes);
+    }
+    CompNode *n = &comp_nodes[comp_node_count];
+    n->child = n->sibling = n->best = -1;
+    n->c = c;
+    return comp_node_count++;
+}
+
+static int *comp_hash_slot(const char *text)
+{
+    unsigned long h = hash_str(text);
+    for (int i = h & (comp_hash_cap - 1);; i = (i + 1) & (comp_hash_cap - 1))
+        if (comp_hash[i] < 0 || strcmp(comp_texts[comp_hash[i]].text, text) == 0)
+            return &comp_hash[i];
+}
+
+static void comp_grow_hash(void)
+{
+    free(comp_hash);
+    comp_hash_cap = comp_hash_cap ? comp_hash_cap * 2 : 1024;
+    comp_hash = malloc(comp_hash_cap * sizeof *comp_hash);
+    for (int i = 0; i < comp_hash_cap; ++i) comp_hash[i] = -1;
+    for (int i = 0; i < comp_text_count; ++i)
+        *comp_hash_slot(comp_texts[i].text) = i;
+}
+
+static void comp_add(const char *text)
+{
+    if (!*text || comp_shed_out) return;
+    if (comp_node_count == 0) comp_new_node('\0');
+    if (2 * (comp_text_count + 1) > comp_hash_cap) comp_grow_hash();
+
+    int *slot = comp_hash_slot(text);
+    if (*slot < 0) {
+        if (comp_text_count == comp_text_cap) {
+            comp_text_cap = comp_text_cap ? comp_text_cap * 2 : 256;
+            comp_texts = realloc(comp_texts, comp_text_cap * sizeof *comp_texts);
+        }
+        comp_texts[comp_text_count] = (CompText){ strdup(text), 0, 0 };
+        *slot = comp_text_count++;
+    }
+    int idx = *slot;
+    comp_texts[idx].count++;
+    comp_texts[idx].last = ++comp_stamp;
+
+    // a text's rank only ever goes up, so re-checking its own path is enough
+    int node = 0;
+    if (comp_better(idx, comp_nodes[node].best)) comp_nodes[node].best = idx;
+    for (int d = 0; text[d] && d < COMP_DEPTH; ++d) {
+        int c = comp_nodes[node].child;
+        while (c >= 0 && comp_nodes[c].c != text[d]) c = comp_nodes[c].sibling;
+        if (c < 0) {
+            c = comp_new_node(text[d]);
+            comp_nodes[c].sibling = comp_nodes[node].child;
+            comp_nodes[node].child = c;
+        }
+        node = c;
+        if (comp_better(idx, comp_nodes[node].best)) comp_nodes[node].best = idx;
+    }
+}
+
+/* best known text starting with prefix, or NULL */
+static const char *comp_lookup(const char *prefix)
+{
+    if (comp_shed_out && *prefix) comp_rebuild();
+    if (comp_node_count == 0 || !*prefix) return NULL;
+
+    int node = 0;
+    for (int d = 0; prefix[d] && d < COMP_DEPTH; ++d) {
+        int c = comp_nodes[node].child;
+        while (c >= 0 && comp_nodes[c].c != prefix[d]) c = comp_nodes[c].sibling;
+        if (c < 0) return NULL;
+        node = c;
+    }
+    const char *best = comp_texts[comp_nodes[node].best].text;
+    return strncmp(best, prefix, strlen(prefix)) == 0 ? best : NULL;
+}
+
+static void comp_clear(void)
+{
+    for (int i = 0; i < comp_text_count; ++i) free(comp_texts[i].text);
+    comp_text_count = comp_node_count = 0;
+    comp_stamp = 0;
+    for (int i = 0; i < comp_hash_cap; ++i) comp_hash[i] = -1;
+}
+
+static size_t comp_bytes(void)
+{
+    size_t bytes = (size_t)comp_text_cap * sizeof *comp_texts + (size_t)comp_node_cap * sizeof *comp_nodes +
+                   (size_t)comp_hash_cap * sizeof *comp_hash;
+    for (int i = 0; i < comp_text_count; ++i) bytes += strlen(comp_texts[i].text) + 1;
+    return bytes;
+}
+
+static void comp_shed(void)
+{
+    comp_clear();
+    free(comp_texts);
+    free(comp_nodes);
+    free(comp_hash);
+    comp_texts = NULL;
+    comp_nodes = NULL;
+    comp_hash = NULL;
+    comp_text_cap = comp_node_cap = comp_hash_cap = 0;
+    comp_shed_out = true;
+}
+
+/* archive first so live items count as the more recent uses */
+static void comp_rebuild(void)
+{
+    comp_clear();
+    comp_shed_out = false;
+
+    char path[PATH_MAX];
+    sidecar_path(path, sizeof path, "todo.archive.txt");
+    FILE *f = store_open(path);
+    if (f) {
+        char line[MAX_LINE];
+        Todo t;
+        while (fgets(line, sizeof line, f)) {
+            line[strcspn(line, "\r\n")] = '\0';
+            parse_todo_line(line, &t);
+
+            // archived items carry their old priority as a " pri:X" suffix
+            char *pri = strstr(t.text, " pri:");
+            if (pri && strlen(pri) == 6) *pri = '\0';
+            comp_add(t.text);
+        }
+        fclose(f);
+    }
+
+    for (int i = 0; i < todo_count; ++i)
+        comp_add(todos[i].text);
+}
+
+/*
+ * Bottom-line prompt with the best completion shown dimmed after the
+ * cursor. TAB or → accepts it, ESC cancels (buf comes back empty).
+ */
+static void prompt_line(const char *label, char *buf, int size, bool complete)
+{
+    int len = 0;
+    buf[0] = '\0';
+    curs_set(1);
+
+    for (;;) {
+        move(LINES - 1, 0);
+        clrtoeol();
+        attron(COLOR_PAIR(2) | A_BOLD);
+        printw("%s", label);
+        attroff(COLOR_PAIR(2) | A_BOLD);
+        printw("%s", buf);
+
+        int y, x;
+        getyx(stdscr, y, x);
+        const char *hint = complete ? comp_lookup(buf) : NULL;
+        if (hint && (int)strlen(hint) > len && x < COLS - 1) {
+            attron(COLOR_PAIR(6) | A_DIM);
+            addnstr(hint + len, COLS - x - 1);
+            attroff(COLOR_PAIR(6) | A_DIM);
+        }
+        move(y, x);
+        refresh();
+
+        int ch = getch();
+        if (ch == '\n' || ch == KEY_ENTER) break;
+        if (ch == 27) { buf[0] = '\0'; break; }
+
+        if (ch == KEY_BACKSPACE || ch == 127 || ch == 8) {
+            // drop a whole UTF-8 sequence
+            while (len > 0 && ((unsigned char)buf[len - 1] & 0xC0) == 0x80) --len;
+            if (len > 0) --len;
+            buf[len] = '\0';
+        } else if ((ch == '\t' || ch == KEY_RIGHT) && hint) {
+            strncpy(buf, hint, size - 1);
+            buf[size - 1] = '\0';
+            len = strlen(buf);
+        } else if (ch >= 32 && ch < 256 && ch != 127 && len < size - 1) {
+            buf[len++] = (char)ch;
+            buf[len] = '\0';
+        }
+    }
+
+    curs_set(0);
+}
+
+static void archive_write(Todo *t, void *f)
+{
+    if (t->completed) write_todo_line(f, t);
+}
+
+static void archive_completed_todos(void)
+{
+    sidecar_path(archive_path, sizeof archive_path, "todo.archive.txt");
+
+    FILE *f = store_create(archive_path, true);
+    if (!f) {
+        perror("archive write");
+        return;
+    }
+
+    // Write all completed todos in list order, then drop them
+    for_each_todo(archive_write, f);
+    if (!store_commit(f, archive_path)) {
+        perror("archive write");
+        return;
+    }
+
+    // keep the selection on the item, or the nearest one that stays
+    int n = view_count(), k = selected_index;
+    while (k < n && view_at(k)->completed) k++;
+    if (k == n) {
+        k = selected_index;
+        while (k >= 0 && k < n && view_at(k)->completed) k--;
+    }
+    int keep = (k >= 0 && k < n) ? view_at(k)->id : -1;
+
+    int write_count = 0;
+    for (int i = 0; i < todo_count; ) {
+        Todo *t = &todos[i];
+        if (!t->completed) {
+            i++;
+            continue;
+        }
+
+        todo_removed(t);
+
+        // storage order is irrelevant, fill the hole with the last item
+        todos[i] = todos[--todo_count];
+        write_count++;
+    }
+
+    reindex_todos();
+    if (write_count > 0) save_todos_to_file();
+    restore_selection(keep);
+}
+
+
+/* a new open item dated today at the end of todos[]; the caller indexes and places it */
+static Todo *append_todo(const char *text, const char *type)
+{
+    if (todo_count >= MAX_TODOS || !text[0]) return NULL;
+
+    Todo new_todo;
+    memset(&new_todo, 0, sizeof(Todo));
+
+    // Set today's date
+    time_t now = time(NULL);
+    struct tm *tm = localtime(&now);
+    strftime(new_todo.date, sizeof new_todo.date, "%Y-%m-%d", tm);
+
+    strncpy(new_todo.type, type, MAX_TYPE - 1);
+
+    // Default to not completed
+    new_todo.completed = false;
+
+    snprintf(new_todo.text, sizeof new_todo.text, "%s", text);
+    new_todo.id = alloc_id();
+    comp_add(new_todo.text);
+
+    todos[todo_count++] = new_todo;
+    return &todos[todo_count - 1];
+}
+
+/* add text to the current context, placed per insert_mode, and save */
+static Todo *insert_todo(const char *text)
+{
+    // Placed after the selected item, or at the top/bottom (insert_mode)
+    Todo *sel = view_at(selected_index);
+    Todo *t = append_todo(text, types[selected_type]);
+    if (!t) return NULL;
+    reindex_todos();
+    seq_place(t, sel);
+    todo_changed(t);
+    run_hook(EV_ADD, t);
+    save_todos_to_file();
+    selected_index = view_rank(t);
+    return t;
+}
+
+static void add_new_todo(void)
+{
+    if (todo_count >= MAX_TODOS) return;
+
+    // Prompt for text, completing from earlier todos
+    char text[MAX_LINE];
+    prompt_line("New todo: ", text, sizeof text, true);
+    insert_todo(text);
+}
+
+static void group_todos_by_completed(void)
+{
+    static Todo *current[MAX_TODOS], *grouped[MAX_TODOS];
+    int n = view_collect(current);
+    int group_count = 0;
+
+    // First: uncompleted
+    for (int i = 0; i < n; ++i)
+        if (!current[i]->completed)
+            grouped[group_count++] = current[i];
+
+    // Then: completed
+    for (int i = 0; i < n; ++i)
+        if (current[i]->completed)
+            grouped[group_count++] = current[i];
+
+    // Reinsert grouped section
+    seq_reassign(current, grouped, n);
+}
+
+
+static int compare_date(const void *a, const void *b)
+{
+    const Todo *ta = *(Todo *const *)a;
+    const Todo *tb = *(Todo *const *)b;
+
+    int cmp = strncmp(ta->date, tb->date, 10);
+    return sort_date_descending ? -cmp : cmp;
+}
+static int compare_priority(const void *a, const void *b)
+{
+    const Todo *ta = *(Todo *const *)a;
+    const Todo *tb = *(Todo *const *)b;
+
+    int pa = (ta->priority[0] == '(') ? ta->priority[1] : 127;
+    int pb = (tb->priority[0] == '(') ? tb->priority[1] : 127;
+
+    return sort_descending ? pb - pa : pa - pb;
+}
+
+static void sort_todos_by_date(bool descending)
+{
+    static Todo *current[MAX_TODOS], *sorted[MAX_TODOS];
+    int count = view_collect(current);
+    memcpy(sorted, current, count * sizeof *sorted);
+
+    sort_date_descending = descending;
+    qsort(sorted, count, sizeof *sorted, compare_date);
+
+    seq_reassign(current, sorted, count);
+}
+
+static void sort_todos_by_priority(bool descending)
+{
+    static Todo *current[MAX_TODOS], *sorted[MAX_TODOS];
+
+    // collect matching todos
+    int count = view_collect(current);
+    memcpy(sorted, current, count * sizeof *sorted);
+
+    sort_descending = descending;
+    qsort(sorted, count, sizeof *sorted, compare_priority);
+
+    // reinsert sorted section
+    seq_reassign(current, sorted, count);
+}
+
+static int global_rank(const Todo *t)
+{
+    return seq_tree_rank(SEQ_ALL, seq_all_root, order_key[t->id]);
+}
+
+/* swap the selected item with its neighbour in the current view */
+static void move_selected(int delta)
+{
+    Todo *t = view_at(selected_index);
+    Todo *other = view_at(selected_index + delta);
+    if (!t || !other) return;
+
+    int a = global_rank(t), b = global_rank(other);
+    bool same_len = line_len[t->id] == line_len[other->id];
+
+    seq_swap(t, other);
+    selected_index += delta;
+
+    // equal lengths: nothing in between shifts, two lines are enough
+    if (same_len && abs(a - b) > 1) {
+        persist_lines(a, a);
+        persist_lines(b, b);
+    } else {
+        persist_lines(a < b ? a : b, a < b ? b : a);
+    }
+}
+
+static void move_selected_to_top(void)
+{
+    Todo *t = view_at(selected_index);
+    Todo *first = view_at(0);
+    if (!t || t == first) return;
+
+    int lo = global_rank(first), hi = global_rank(t);
+
+    seq_unlink_item(t->id);
+    order_key[t->id] = seq_key_next_to(first->id, true);
+    seq_link_item(t);
+    store_revision++;
+
+    selected_index = 0;
+    persist_lines(lo, hi);
+}
+
+
+
+static void prompt_priority(void)
+{
+    Todo *t = view_at(selected_index);
+    if (!t) return;
+
+    if (t->completed) {
+        mvprintw(LINES - 1, 0, "❌ Cannot set priority on completed item.");
+        refresh();
+        napms(1000); // wait 1 second
+        move(LINES - 1, 0);
+        clrtoeol();
+        refresh();
+        return;
+    }
+
+    // Prompt user
+    echo();
+    curs_set(1);
+    mvprintw(LINES - 1, 0, "Set priority (a-z, or space to clear): ");
+    int ch = getch();
+    noecho();
+    curs_set(0);
+
+    if (ch == ' ' || ch == KEY_BACKSPACE || ch == 127) {
+        t->priority[0] = '\0'; // clear
+    } else if (isalpha(ch)) {
+        ch = toupper(ch);
+        snprintf(t->priority, sizeof t->priority, "(%c)", ch);
+    }
+    todo_changed(t);
+
+    save_todos_to_file();
+
+    move(LINES - 1, 0);
+    clrtoeol();
+    refresh();
+}
+
+
+
+
+/*
+ * Index of type, added if new. The slot of a context that has been left
+ * empty (all items moved or archived) is reused, so jumping around with
+ * `@` does not grow the list for the rest of the session.
+ */
+static int add_type(const char *type)
+{
+    int reuse = -1;
+    for (int i = 0; i < type_count; ++i) {
+        if (strcmp(types[i], type) == 0) return i;
+        if (reuse < 0 && i > 0 && i != selected_type && seq_ctx_root[i] < 0) reuse = i;
+    }
+    if (reuse >= 0) {
+        free(types[reuse]);
+        types[reuse] = strdup(type);
+        memset(ctx_sums[reuse], 0, sizeof ctx_sums[reuse]);
+        store_revision++;
+        return reuse;
+    }
+    if (type_count >= MAX_TODOS) return 0;
+    types[type_count] = strdup(type);
+    return type_count++;
+}
+
+/* move t to context type, placed there per insert_mode */
+static void retype_todo(Todo *t, const char *type)
+{
+    // leaves the old context's order, enters the new one per insert_mode
+    add_type(type);
+    seq_unlink_item(t->id);
+    snprintf(t->type, sizeof t->type, "%s", type);
+    seq_place(t, NULL);
+    todo_changed(t);
+    save_todos_to_file();
+}
+
+static char filter_error[64];
+
+/* `/`: filter the view by regex, ENTER on an empty line clears it */
+static void prompt_filter(void)
+{
+    char pattern[MAX_LINE];
+    int sel = selected_id();
+    prompt_line("/", pattern, sizeof pattern, false);
+
+    const char *err = set_filter(pattern);
+    snprintf(filter_error, sizeof filter_error, "%s", err ? err : "");
+    selected_index = 0;
+    restore_selection(sel);
+}
+
+static void prompt_type(void)
+{
+    Todo *t = view_at(selected_index);
+    if (!t) return;
+
+    // Prompt for new type
+    echo();
+    curs_set(1);
+    char input[MAX_TYPE] = {0};
+    move(LINES - 1, 0);
+    clrtoeol();
+    attron(COLOR_PAIR(2) | A_BOLD);
+    printw("Change type to @");
+    attroff(COLOR_PAIR(2) | A_BOLD);
+    getnstr(input, MAX_TYPE - 1);
+    noecho();
+    curs_set(0);
+
+    if (strlen(input) > 0) {
+        retype_todo(t, input);
+
+        if (strcmp(types[selected_type], "all") == 0)
+            selected_index = view_rank(t);
+        else if (selected_index >= view_count() && selected_index > 0)
+            selected_index--;
+    }
+
+    move(LINES - 1, 0);
+    clrtoeol();
+    refresh();
+}
+/* ─────────────────────────────────────────────── file I/O ── */
+
+/* what the file looked like after our last write, see persist_lines */
+static struct stat saved_stat;
+
+static void remember_saved_file(void)
+{
+    if (stat(todo_filename, &saved_stat) != 0)
+        memset(&saved_stat, 0, sizeof saved_stat);
+}
+
+/* split one todo.txt line into t; t->id is left for the caller */
+static void parse_todo_line(const char *line, Todo *t)
+{
+    memset(t, 0, sizeof(Todo));
+    t->completed = false;
+
+    const char *p = line;
+
+    // 1. check if line starts with "x " (completed)
+    if (strncmp(p, "x ", 2) == 0) {
+        t->completed = true;
+        p += 2;
+        sscanf(p, "%10s", t->completion_date);
+        p += strlen(t->completion_date);
+        while (isspace((unsigned char)*p)) p++;
+    }
+
+    // 2. check for priority first (before date)
+    if (p[0] == '(' && isalpha((unsigned char)p[1]) && p[2] == ')') {
+        strncpy(t->priority, p, 3);
+        t->priority[3] = '\0';
+        p += 4;
+        while (isspace((unsigned char)*p)) p++;
+    } else {
+        t->priority[0] = '\0';
+    }
+
+    // 3. extract date
+    sscanf(p, "%10s", t->date);
+    p += strlen(t->date);
+    while (isspace((unsigned char)*p)) p++;
+
+    // 4. if priority wasn't found before, check again after date
+    if (t->priority[0] == '\0' && p[0] == '(' && isalpha((unsigned char)p[1]) && p[2] == ')') {
+        strncpy(t->priority, p, 3);
+        t->priority[3] = '\0';
+        p += 4;
+        while (isspace((unsigned char)*p)) p++;
+    }
+
+    // 5. extract @type
+    if (*p == '@') {
+        ++p;
+        sscanf(p, "%31s", t->type);
+        p += strlen(t->type);
+        while (isspace((unsigned char)*p)) p++;
+    } else {
+        strcpy(t->type, "all");
+    }
+
+    // 6. remaining is the text
+    strncpy(t->text, p, MAX_LINE - 1);
+    t->id = -1;
+}
+
+/* set before a reload: the id of the matching reloaded item ends up in load_follow_id */
+static const Todo *load_follow = NULL;
+static int load_follow_id = -1;
+
+void load_todos(const char *filename) {
+    FILE *f = store_open(filename);
+    if (!f) {
+        perror("open");
+        exit(1);
+    }
+    // Clear current todos and types
+	// In case we run it again
+    todo_count = 0;
+    reset_ids();
+    seq_reset();
+    for (int i = 0; i < type_count; ++i) {
+        free(types[i]);
+    }
+	
+    type_count = 0;
+// After clearing types and todos, add the virtual type
+types[type_count++] = strdup("all");
+
+    char line[MAX_LINE];
+    while (fgets(line, sizeof(line), f)) {
+        if (todo_count >= MAX_TODOS) break;
+
+        // Trim trailing newlines
+        line[strcspn(line, "\r\n")] = '\0';
+
+        Todo *t = &todos[todo_count];
+        parse_todo_line(line, t);
+        add_type(t->type);
+        t->id = alloc_id();
+        order_key[t->id] = (long)(todo_count + 1) * ORDER_STEP;
+        seq_link_item(t);
+        if (load_follow && load_follow_id < 0 &&
+            strcmp(t->text, load_follow->text) == 0 &&
+            strcmp(t->type, load_follow->type) == 0 &&
+            strcmp(t->date, load_follow->date) == 0)
+            load_follow_id = t->id;
+        todo_count++;
+    }
+
+    fclose(f);
+    // the file may not be in canonical form yet, first write is a full save
+    memset(&saved_stat, 0, sizeof saved_stat);
+    reindex_todos();
+    next_rebuild();
+    esc_rebuild();
+    tags_rebuild();
+    tri_rebuild();
+    tree_rebuild();
+    comp_rebuild();
+}
+
+
+/* the line as saved, with its '\n'; returns the length */
+static int format_todo_line(char *buf, size_t size, const Todo *t)
+{
+    int n;
+    if (t->completed) {
+        // Save completed format:
+        // x <completion_date> <original_date> @type text [pri:X]
+        n = snprintf(buf, size, "x %s %s @%s %s\n", t->completion_date, t->date, t->type, t->text);
+
+    } else {
+        // Save incomplete format:
+        // (X) <date> @type text
+        if (t->priority[0] != '\0')
+            n = snprintf(buf, size, "%s %s @%s %s\n", t->priority, t->date, t->type, t->text);
+        else
+            n = snprintf(buf, size, "%s @%s %s\n", t->date, t->type, t->text);
+    }
+    return n < (int)size ? n : (int)size - 1;
+}
+
+static void write_todo_line(FILE *f, const Todo *t)
+{
+    char line[MAX_LINE * 2];
+    fwrite(line, 1, format_todo_line(line, sizeof line, t), f);
+}
+
+static void save_line(Todo *t, void *f)
+{
+    write_todo_line(f, t);
+}
+
+static void save_todos_to_file(void)
+{
+    sync_adopt();
+
+    FILE *f = store_create(todo_filename, false);
+    if (!f) { perror("write"); return; }
+
+    for_each_todo(save_line, f);
+
+    if (!store_commit(f, todo_filename)) perror("write");
+    remember_saved_file();
+    sync_flush();
+}
+
+/*
+ * Rewrite only the lines at list positions lo..hi, in place. After a move
+ * those lines are a permutation of what was there, so nothing else in the
+ * file shifts. Falls back to a full save if the file changed under us, and
+ * for sealed files, whose save already rewrites only the chunks touched.
+ */
+static void persist_lines(int lo, int hi)
+{
+    struct stat st;
+    if (crypt_on || stat(todo_filename, &st) != 0 || st.st_size != saved_stat.st_size ||
+        st.st_mtim.tv_sec != saved_stat.st_mtim.tv_sec ||
+        st.st_mtim.tv_nsec != saved_stat.st_mtim.tv_nsec) {
+        save_todos_to_file();
+        return;
+    }
+
+    int first = seq_tree_select(SEQ_ALL, seq_all_root, lo);
+    int last  = seq_tree_select(SEQ_ALL, seq_all_root, hi);
+    if (first < 0 || last < 0) return;
+
+    long off = seq_offset(first);
+    size_t size = seq_offset(last) + line_len[last] - off, used = 0;
+    char *buf = malloc(size + MAX_LINE * 2);
+
+    for (int r = lo; r <= hi; ++r) {
+        const Todo *t = todo_by_id(seq_tree_select(SEQ_ALL, seq_all_root, r));
+        used += format_todo_line(buf + used, MAX_LINE * 2, t);
+    }
+
+    int fd = open(todo_filename, O_WRONLY);
+    if (fd < 0 || used != size || pwrite(fd, buf, size, off) != (ssize_t)size) {
+        if (fd >= 0) close(fd);
+        free(buf);
+        save_todos_to_file();
+        return;
+    }
+    close(fd);
+    free(buf);
+    remember_saved_file();
+    sync_flush();
+}
+
+
+/* ─────────────────────────────────────────────────────────── import ── */
+
+/*
+ * `nntm import <todo-file> <export.csv|export.json>` streams records out
+ * of another tracker's export and maps the usual field names onto todo.txt
+ * lines. They are added to the loaded list like interactive adds, so they
+ * reach the --sync op log, and the list replaces the file in one rename.
+ * An import that would take the list past MAX_TODOS is refused.
+ */
+enum { F_TEXT, F_PRIORITY, F_CREATED, F_DONE, F_DONE_DATE, F_CONTEXT, F_TAGS, F_DUE, F_COUNT };
+
+static const char *import_aliases[F_COUNT][8] = {
+    [F_TEXT]      = { "text", "title", "name", "summary", "task", "content", "subject" },
+    [F_PRIORITY]  = { "priority", "prio", "pri" },
+    [F_CREATED]   = { "created", "created_at", "date", "created date", "creation date", "added", "createdate" },
+    [F_DONE]      = { "completed", "done", "status", "state", "is_completed", "checked", "complete" },
+    [F_DONE_DATE] = { "completed_at", "completed date", "completion date", "done_at", "finished", "completed_on", "completiondate" },
+    [F_CONTEXT]   = { "context", "project", "list", "section", "category", "folder" },
+    [F_TAGS]      = { "tags", "labels", "label", "tag" },
+    [F_DUE]       = { "due", "due_date", "due date", "deadline", "duedate" },
+};
+
+typedef struct {
+    char field[F_COUNT][MAX_LINE];
+} ImportRecord;
+
+static const char *import_context = "all";
+
+static int import_field(const char *name)
+{
+    while (isspace((unsigned char)*name)) name++;
+    for (int f = 0; f < F_COUNT; ++f)
+        for (int a = 0; a < 8 && import_aliases[f][a]; ++a)
+            if (strcasecmp(name, import_aliases[f][a]) == 0) return f;
+    return -1;
+}
+
+/* anything that looks like a date or a unix timestamp -> YYYY-MM-DD */
+static bool import_date(const char *in, char *out)
+{
+    while (isspace((unsigned char)*in)) in++;
+    if (strlen(in) >= 10 && isdigit((unsigned char)in[0]) &&
+        (in[4] == '-' || in[4] == '/') && (in[7] == '-' || in[7] == '/')) {
+        char buf[11];
+        snprintf(buf, sizeof buf, "%.4s-%.2s-%.2s", in, in + 5, in + 8);
+        if (day_number(buf) < 0) return false;
+        strcpy(out, buf);
+        return true;
+    }
+
+    char *end;
+    long long ts = strtoll(in, &end, 10);
+    if (end == in || *end || ts <= 0) return false;
+    if (ts > 100000000000LL) ts /= 1000;   /* milliseconds */
+    time_t tt = (time_t)ts;
+    strftime(out, 11, "%Y-%m-%d", localtime(&tt));
+    return true;
+}
+
+static char import_priority(const char *in)
+{
+    while (isspace((unsigned char)*in)) in++;
+    if (isalpha((unsigned char)in[0]) && (!in[1] || in[1] == ')'))
+        return toupper((unsigned char)in[0]);
+    if (in[0] == '(' && isalpha((unsigned char)in[1])) return toupper((unsigned char)in[1]);
+    if (isdigit((unsigned char)in[0])) {
+        int n = atoi(in);
+        return n >= 1 && n <= 26 ? 'A' + n - 1 : 0;
+    }
+    if (!strcasecmp(in, "urgent") || !strcasecmp(in, "highest") || !strcasecmp(in, "high")) return 'A';
+    if (!strcasecmp(in, "medium") || !strcasecmp(in, "normal")) return 'B';
+    if (!strcasecmp(in, "low"))    return 'C';
+    if (!strcasecmp(in, "lowest")) return 'D';
+    return 0;
+}
+
+static bool import_truthy(const char *in)
+{
+    static const char *yes[] = { "true", "yes", "1", "x", "done", "completed",
+                                 "complete", "closed", "resolved", "finished" };
+    while (isspace((unsigned char)*in)) in++;
+    for (size_t i = 0; i < sizeof yes / sizeof *yes; ++i)
+        if (strcasecmp(in, yes[i]) == 0) return true;
+    return false;
+}
+
+/* no spaces or '@' in a type, and it has to fit MAX_TYPE */
+static void import_type(const char *in, char *out)
+{
+    int n = 0;
+    while (isspace((unsigned char)*in) || *in == '@') in++;
+    for (; *in && n < MAX_TYPE - 1; ++in)
+        out[n++] = isspace((unsigned char)*in) ? '-' : *in;
+    while (n > 0 && out[n - 1] == '-') n--;
+    out[n] = '\0';
+}
+
+static bool import_emit(FILE *out, const ImportRecord *r)
+{
+    Todo t;
+    memset(&t, 0, sizeof t);
+
+    const char *text = r->field[F_TEXT];
+    while (isspace((unsigned char)*text)) text++;
+    if (!*text) return false;
+
+    size_t len = 0;
+    for (; *text && len < MAX_LINE - 1; ++text)
+        t.text[len++] = (*text == '\n' || *text == '\r' || *text == '\t') ? ' ' : *text;
+
+    if (!import_date(r->field[F_CREATED], t.date)) {
+        time_t now = time(NULL);
+        strftime(t.date, sizeof t.date, "%Y-%m-%d", localtime(&now));
+    }
+
+    import_type(r->field[F_CONTEXT], t.type);
+    if (!t.type[0]) strncpy(t.type, import_context, MAX_TYPE - 1);
+
+    // tags become +tag words, a due date becomes a due: tag
+    char tags[MAX_LINE];
+    strncpy(tags, r->field[F_TAGS], sizeof tags);
+    for (char *tok = strtok(tags, ",; "); tok; tok = strtok(NULL, ",; ")) {
+        if (*tok == '+' || *tok == '#') tok++;
+        if (*tok && len + strlen(tok) + 2 < MAX_LINE)
+            len += snprintf(t.text + len, MAX_LINE - len, " +%s", tok);
+    }
+    char due[11];
+    if (import_date(r->field[F_DUE], due) && len + 16 < MAX_LINE)
+        len += snprintf(t.text + len, MAX_LINE - len, " due:%s", due);
+
+    char prio = import_priority(r->field[F_PRIORITY]);
+    t.completed = import_truthy(r->field[F_DONE]) || r->field[F_DONE_DATE][0];
+    if (t.completed) {
+        if (!import_date(r->field[F_DONE_DATE], t.completion_date))
+            strcpy(t.completion_date, t.date);
+        if (prio && len + 6 < MAX_LINE)
+            snprintf(t.text + len, MAX_LINE - len, " pri:%c", prio);
+    } else if (prio) {
+        snprintf(t.priority, sizeof t.priority, "(%c)", prio);
+    }
+
+    write_todo_line(out, &t);
+    return true;
+}
+
+/* ── CSV: RFC 4180, header row names the columns ── */
+
+/* next field into buf; returns the char that ended it: ',', '\n' or EOF */
+static int csv_field(FILE *in, char *buf, size_t size)
+{
+    size_t n = 0;
+    int c = fgetc(in);
+    bool quoted = (c == '"');
+    if (quoted) c = fgetc(in);
+
+    for (;; c = fgetc(in)) {
+        if (c == EOF) break;
+        if (quoted && c == '"') {
+            c = fgetc(in);
+            if (c != '"') {
+                quoted = false;
+                if (c == ',' || c == '\n' || c == EOF) break;
+            }
+        } else if (!quoted && (c == ',' || c == '\n')) {
+            break;
+        }
+        if (c == '\r' && !quoted) continue;
+        if (n + 1 < size) buf[n++] = (char)c;
+    }
+    buf[n] = '\0';
+    return c;
+}
+
+static int import_csv(FILE *in, FILE *out)
+{
+    int cols[64];
+    int ncols = 0, end, count = 0;
+    char buf[MAX_LINE];
+
+    do {
+        end = csv_field(in, buf, sizeof buf);
+        if (ncols < 64) cols[ncols++] = import_field(buf);
+    } while (end == ',');
+
+    ImportRecord *r = malloc(sizeof *r);
+    while (!feof(in)) {
+        memset(r, 0, sizeof *r);
+        int col = 0;
+        do {
+            end = csv_field(in, buf, sizeof buf);
+            if (col < ncols && cols[col] >= 0)
+                strcpy(r->field[cols[col]], buf);
+            col++;
+        } while (end == ',');
+        if (import_emit(out, r)) count++;
+    }
+    free(r);
+    return count;
+}
+
+/* ── JSON: an array of objects, or an object holding such arrays ── */
+
+static int json_peek(FILE *in)
+{
+    int c;
+    while ((c = fgetc(in)) != EOF && isspace(c)) ;
+    if (c != EOF) ungetc(c, in);
+    return c;
+}
+
+/* cp as UTF-8, whole or not at all */
+static void json_utf8(char *buf, size_t *n, size_t size, unsigned cp)
+{
+    char enc[4];
+    int len = 0;
+    if (cp < 0x80) enc[len++] = (char)cp;
+    else if (cp < 0x800) {
+        enc[len++] = (char)(0xC0 | (cp >> 6));
+        enc[len++] = (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        enc[len++] = (char)(0xE0 | (cp >> 12));
+        enc[len++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        enc[len++] = (char)(0x80 | (cp & 0x3F));
+    } else {
+        enc[len++] = (char)(0xF0 | (cp >> 18));
+        enc[len++] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        enc[len++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        enc[len++] = (char)(0x80 | (cp & 0x3F));
+    }
+    if (*n + len < size) {
+        memcpy(buf + *n, enc, len);
+        *n += len;
+    }
+}
+
+static void json_string(FILE *in, char *buf, size_t size)
+{
+    size_t n = 0;
+    unsigned hi = 0;     /* a high surrogate waiting for its low half */
+    fgetc(in);   /* opening quote */
+    for (int c; (c = fgetc(in)) != EOF && c != '"'; ) {
+        bool u = false;
+        unsigned cp = 0;
+        if (c == '\\') {
+            c = fgetc(in);
+            switch (c) {
+            case 'n': c = ' ';  break;
+            case 't': c = ' ';  break;
+            case 'r': c = ' ';  break;
+            case 'b': case 'f': c = ' '; break;
+            case 'u': {
+                char hex[5] = {0};
+                for (int i = 0; i < 4; ++i) hex[i] = (char)fgetc(in);
+                cp = (unsigned)strtoul(hex, NULL, 16);
+                u = true;
+                break;
+            }
+            }
+        }
+        // surrogates pair up into one 4-byte sequence, a lone half is U+FFFD
+        if (hi && !(u && cp >= 0xDC00 && cp < 0xE000)) {
+            json_utf8(buf, &n, size, 0xFFFD);
+            hi = 0;
+        }
+        if (!u) {
+            if (n + 1 < size) buf[n++] = (char)c;
+            continue;
+        }
+        if (cp >= 0xD800 && cp < 0xDC00) {
+            hi = cp;
+            continue;
+        }
+        if (cp >= 0xDC00 && cp < 0xE000) {
+            cp = hi ? 0x10000 + ((hi - 0xD800) << 10) + (cp - 0xDC00) : 0xFFFD;
+            hi = 0;
+        }
+        json_utf8(buf, &n, size, cp);
+    }
+    if (hi) json_utf8(buf, &n, size, 0xFFFD);
+    buf[n] = '\0';
+}
+
+static void json_value(FILE *in, char *buf, size_t size, int depth);
+
+/* arrays of scalars are joined with commas (tags), nested objects give
+ * their "name" or "title" (e.g. "project": {"name": "x"}) */
+static void json_container(FILE *in, char *buf, size_t size, int depth)
+{
+    bool object = (fgetc(in) == '{');
+    char key[64], val[MAX_LINE];
+    size_t n = 0;
+    buf[0] = '\0';
+
+    for (;;) {
+        int c = json_peek(in);
+        if (c == EOF) return;
+        if (c == ']' || c == '}') { fgetc(in); return; }
+        if (c == ',') { fgetc(in); continue; }
+
+        if (object) {
+            json_string(in, key, sizeof key);
+            if (json_peek(in) == ':') fgetc(in);
+        }
+        json_value(in, val, sizeof val, depth + 1);
+
+        if (object ? (!strcasecmp(key, "name") || !strcasecmp(key, "title")) && !buf[0]
+                   : val[0] != '\0') {
+            int w = snprintf(buf + n, size - n, "%s%s", n && !object ? "," : "", val);
+            if (w > 0 && (size_t)w < size - n) n += w;
+        }
+    }
+}
+
+static void json_value(FILE *in, char *buf, size_t size, int depth)
+{
+    int c = json_peek(in);
+    buf[0] = '\0';
+    if (c == '"') {
+        json_string(in, buf, size);
+    } else if (c == '[' || c == '{') {
+        if (depth > 32) { fgetc(in); return; }
+        json_container(in, buf, size, depth);
+    } else {
+        size_t n = 0;
+        while ((c = fgetc(in)) != EOF && !strchr(",]}", c) && !isspace(c))
+            if (n + 1 < size) buf[n++] = (char)c;
+        if (c != EOF) ungetc(c, in);
+        buf[n] = '\0';
+        if (strcmp(buf, "null") == 0 || strcmp(buf, "false") == 0) buf[0] = '\0';
+    }
+}
+
+static int json_records(FILE *in, FILE *out, ImportRecord *r)
+{
+    int count = 0;
+    char key[64], val[MAX_LINE];
+
+    fgetc(in);   /* '[' */
+    for (;;) {
+        int c = json_peek(in);
+        if (c == EOF) return count;
+        if (c == ']') { fgetc(in); return count; }
+        if (c == ',') { fgetc(in); continue; }
+        if (c != '{') { json_value(in, val, sizeof val, 1); continue; }
+
+        memset(r, 0, sizeof *r);
+        fgetc(in);
+        for (;;) {
+            c = json_peek(in);
+            if (c == EOF || c == '}') { fgetc(in); break; }
+            if (c == ',') { fgetc(in); continue; }
+            json_string(in, key, sizeof key);
+            if (json_peek(in) == ':') fgetc(in);
+            json_value(in, val, sizeof val, 2);
+
+            int f = import_field(key);
+            if (f >= 0 && !r->field[f][0]) strcpy(r->field[f], val);
+        }
+        if (import_emit(out, r)) count++;
+    }
+}
+
+static int import_json(FILE *in, FILE *out)
+{
+    ImportRecord *r = malloc(sizeof *r);
+    char key[64], val[MAX_LINE];
+    int count = 0;
+
+    int c = json_peek(in);
+    if (c == '[') {
+        count = json_records(in, out, r);
+    } else if (c == '{') {
+        // {"tasks": [...], "meta": ...}: every array of objects is records
+        fgetc(in);
+        while ((c = json_peek(in)) != EOF && c != '}') {
+            if (c == ',') { fgetc(in); continue; }
+            json_string(in, key, sizeof key);
+            if (json_peek(in) == ':') fgetc(in);
+            if (json_peek(in) == '[') count += json_records(in, out, r);
+            else json_value(in, val, sizeof val, 1);
+        }
+    }
+    free(r);
+    return count;
+}
+
+static int run_import(int argc, char **argv)
+{
+    const char *format = NULL;
+    const char *src = NULL;
+
+    for (int i = 3; i < argc; ++i) {
+        if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) format = argv[++i];
+        else if (strcmp(argv[i], "--context") == 0 && i + 1 < argc) import_context = argv[++i];
+        else if (strcmp(argv[i], "--sync") == 0 && i + 1 < argc) sync_dir = argv[++i];
+        else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc)
+            snprintf(sync_device, sizeof sync_device, "%s", argv[++i]);
+        else src = argv[i];
+    }
+    if (argc < 4 || !src) {
+        fprintf(stderr, "Usage: %s import <todo-file> <export.csv|export.json> "
+                        "[--format csv|json] [--context type] [--sync dir [--device name]]\n", argv[0]);
+        return 1;
+    }
+    todo_filename = argv[2];
+    if (crypt_sealed(todo_filename)) {
+        fprintf(stderr, "%s is encrypted; open it with --decrypt first\n", todo_filename);
+        return 1;
+    }
+
+    if (!format) {
+        const char *dot = strrchr(src, '.');
+        format = dot && strcasecmp(dot, ".json") == 0 ? "json" : "csv";
+    }
+
+    FILE *in = strcmp(src, "-") == 0 ? stdin : fopen(src, "r");
+    if (!in) { perror(src); return 1; }
+
+    // the records first: the list is only touched once they are known to fit
+    char *lines = NULL;
+    size_t lines_len = 0;
+    FILE *out = open_memstream(&lines, &lines_len);
+    if (!out) { perror("import"); return 1; }
+    int count = strcmp(format, "json") == 0 ? import_json(in, out) : import_csv(in, out);
+    if (in != stdin) fclose(in);
+    fclose(out);
+
+    // loading stops at MAX_TODOS and the save drops the rest, so count the file as it loads
+    int existing = 0;
+    FILE *old = fopen(todo_filename, "r");
+    if (old) {
+        char line[MAX_LINE];
+        while (fgets(line, sizeof line, old)) existing++;
+        fclose(old);
+    } else if (errno == ENOENT && (old = fopen(todo_filename, "a"))) {
+        fclose(old);
+    } else {
+        perror(todo_filename);
+        return 1;
+    }
+    load_todos(todo_filename);
+    sync_start();
+    if (existing < todo_count) existing = todo_count;
+    if (existing + count > MAX_TODOS) {
+        fprintf(stderr, "%s: %d items plus %d imported is more than the %d nntm keeps; nothing imported\n",
+                todo_filename, existing, count, MAX_TODOS);
+        free(lines);
+        return 1;
+    }
+
+    // as added interactively, at the end of the list
+    static Todo *added[MAX_TODOS];
+    int n = 0;
+    for (char *p = lines, *nl; p < lines + lines_len && (nl = strchr(p, '\n')); p = nl + 1) {
+        *nl = '\0';
+        Todo t;
+        parse_todo_line(p, &t);
+        Todo *a = append_todo(t.text, t.type);
+        if (!a) continue;
+        a->completed = t.completed;
+        memcpy(a->completion_date, t.completion_date, sizeof t.completion_date);
+        memcpy(a->date, t.date, sizeof t.date);
+        memcpy(a->priority, t.priority, sizeof t.priority);
+        add_type(a->type);
+        added[n++] = a;
+    }
+    free(lines);
+    reindex_todos();
+    for (int i = 0; i < n; ++i) {
+        int last = seq_tree_select(SEQ_ALL, seq_all_root, seq_size(SEQ_ALL, seq_all_root) - 1);
+        order_key[added[i]->id] = (last >= 0 ? order_key[last] : 0) + ORDER_STEP;
+        seq_link_item(added[i]);
+        todo_changed(added[i]);
+    }
+
+    // one rename swaps in old + new at once; with --sync the adds also go to the op log
+    Replace r;
+    sync_adopt();
+    if (!replace_open(&r, todo_filename, ".import.tmp")) { perror(todo_filename); return 1; }
+    setvbuf(r.f, NULL, _IOFBF, 1 << 20);
+    for_each_todo(save_line, r.f);
+    if (!replace_commit(&r)) {
+        perror("import write");
+        return 1;
+    }
+    sync_flush();
+
+    printf("Imported %d todos into %s\n", n, todo_filename);
+    return 0;
+}
+
+/* ───────────────────────────────────────────────────────────── grep ── */
+
+/*
+ * `nntm grep <text> <dir>` and the `F` panel: every *.txt file below dir
+ * (todo files and their archives) is mmapped and searched by a pool of
+ * threads, each taking the next file from a shared counter. Matching lines
+ * are parsed like todo lines. Files are sorted by path and each keeps its
+ * hits in line order, so the output never depends on thread timing.
+ */
+typedef struct {
+    long line;
+    Todo todo;
+} GrepHit;
+
+typedef struct {
+    char    *path;
+    GrepHit *hits;
+    int      n, cap;
+} GrepFile;
+
+static GrepFile   *grep_files = NULL;
+static int         grep_nfiles = 0, grep_cap = 0;
+static char        grep_needle[MAX_LINE];   /* copied: the panel shows it after the prompt is gone */
+static size_t      grep_nlen;
+static int         grep_next;        /* next file to search, taken atomically */
+static int         grep_total;       /* hits over all files */
+
+/*
+ * First occurrence of needle in hay. With SSE2, 16 candidate positions at a
+ * time are checked on the needle's first and last byte; only positions where
+ * both agree are compared in full.
+ */
+static const char *find_substr(const char *hay, size_t n, const char *needle, size_t m)
+{
+    if (m == 0 || m > n) return m == 0 ? hay : NULL;
+    if (m == 1) return memchr(hay, needle[0], n);
+#ifdef __SSE2__
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last  = _mm_set1_epi8(needle[m - 1]);
+    size_t i = 0;
+    for (; i + m + 15 <= n; i += 16) {
+        __m128i bf = _mm_loadu_si128((const __m128i *)(hay + i));
+        __m128i bl = _mm_loadu_si128((const __m128i *)(hay + i + m - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, bf), _mm_cmpeq_epi8(last, bl)));
+        for (; mask; mask &= mask - 1) {
+            size_t at = i + (size_t)__builtin_ctz(mask);
+            if (memcmp(hay + at + 1, needle + 1, m - 2) == 0) return hay + at;
+        }
+    }
+    return memmem(hay + i, n - i, needle, m);
+#else
+    return memmem(hay, n, needle, m);
+#endif
+}
+
+static int grep_collect(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    (void)st; (void)ftw;
+    size_t len = strlen(path);
+    if (type != FTW_F || len < 4 || strcmp(path + len - 4, ".txt") != 0) return 0;
+
+    if (grep_nfiles == grep_cap) {
+        grep_cap = grep_cap ? grep_cap * 2 : 64;
+        grep_files = realloc(grep_files, (size_t)grep_cap * sizeof *grep_files);
+        if (!grep_files) { perror("realloc"); exit(1); }
+    }
+    grep_files[grep_nfiles++] = (GrepFile){ strdup(path), NULL, 0, 0 };
+    return 0;
+}
+
+static void grep_file(GrepFile *gf)
+{
+    int fd = open(gf->path, O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) { close(fd); return; }
+    size_t size = (size_t)st.st_size;
+    const char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return;
+    if (size >= CRYPT_HEADER && memcmp(map, CRYPT_MAGIC, 8) == 0) {   /* sealed: nothing to see */
+        munmap((void *)map, size);
+        return;
+    }
+    madvise((void *)map, size, MADV_SEQUENTIAL);
+
+    const char *end = map + size, *p = map, *counted = map, *hit;
+    long line = 1;
+    while ((hit = find_substr(p, end - p, grep_needle, grep_nlen))) {
+        const char *ls = hit, *le = memchr(hit, '\n', end - hit);
+        while (ls > map && ls[-1] != '\n') ls--;
+        if (!le) le = end;
+
+        while (counted < ls) {
+            const char *nl = memchr(counted, '\n', ls - counted);
+            if (!nl) break;
+            line++;
+            counted = nl + 1;
+        }
+        counted = ls;
+
+        if (gf->n == gf->cap) {
+            gf->cap = gf->cap ? gf->cap * 2 : 16;
+            GrepHit *grown = realloc(gf->hits, (size_t)gf->cap * sizeof *grown);
+            if (!grown) break;
+            gf->hits = grown;
+        }
+        char buf[MAX_LINE];
+        size_t len = (size_t)(le - ls) < sizeof buf - 1 ? (size_t)(le - ls) : sizeof buf - 1;
+        memcpy(buf, ls, len);
+        buf[len] = '\0';
+        buf[strcspn(buf, "\r")] = '\0';
+        gf->hits[gf->n].line = line;
+        parse_todo_line(buf, &gf->hits[gf->n].todo);
+        gf->n++;
+
+        p = le < end ? le + 1 : end;
+    }
+    munmap((void *)map, size);
+}
+
+static void *grep_worker(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        int i = __atomic_fetch_add(&grep_next, 1, __ATOMIC_RELAXED);
+        if (i >= grep_nfiles) return NULL;
+        grep_file(&grep_files[i]);
+    }
+}
+
+static int cmp_grep_path(const void *a, const void *b)
+{
+    return strcmp(((const GrepFile *)a)->path, ((const GrepFile *)b)->path);
+}
+
+static void grep_reset(void)
+{
+    for (int i = 0; i < grep_nfiles; ++i) {
+        free(grep_files[i].path);
+        free(grep_files[i].hits);
+    }
+    grep_nfiles = grep_total = 0;
+}
+
+/* search every *.txt below dir for text; results in grep_files */
+static void grep_dir(const char *text, const char *dir)
+{
+    grep_reset();
+    snprintf(grep_needle, sizeof grep_needle, "%s", text);
+    grep_nlen = strlen(grep_needle);
+    if (nftw(dir, grep_collect, 32, FTW_PHYS) != 0) perror(dir);
+    qsort(grep_files, grep_nfiles, sizeof *grep_files, cmp_grep_path);
+
+    grep_next = 0;
+    run_pool(grep_worker, grep_nfiles);
+
+    for (int i = 0; i < grep_nfiles; ++i) grep_total += grep_files[i].n;
+}
+
+/* one hit as "[x] (A) @type text" */
+static void format_hit(char *buf, size_t size, const Todo *t)
+{
+    snprintf(buf, size, "[%c] %-3s @%s %s", t->completed ? 'x' : ' ',
+             t->priority, t->type, t->text);
+}
+
+static int run_grep(int argc, char **argv)
+{
+    if (argc != 4 || !argv[2][0]) {
+        fprintf(stderr, "Usage: %s grep <text> <dir>\n", argv[0]);
+        return 2;
+    }
+    grep_dir(argv[2], argv[3]);
+
+    for (int i = 0; i < grep_nfiles; ++i) {
+        for (int k = 0; k < grep_files[i].n; ++k) {
+            char buf[MAX_LINE * 2];
+            format_hit(buf, sizeof buf, &grep_files[i].hits[k].todo);
+            printf("%s:%ld: %s\n", grep_files[i].path, grep_files[i].hits[k].line, buf);
+        }
+    }
+    return grep_total > 0 ? 0 : 1;
+}
+
+/* ──────────────────────────────────────────────────────────── check ── */
+
+/*
+ * `nntm check <todo-file> [--fix]` validates every line against the form
+ * nntm writes. The file is mmapped and cut into chunks at line breaks,
+ * which the thread pool takes from a shared counter. Problems are kept by
+ * line within their chunk and numbered once every chunk has counted its
+ * lines. With --fix each chunk is also written out in canonical form, and
+ * the chunks replace the file in one rename.
+ */
+enum {
+    CK_EMPTY, CK_LONG, CK_CR, CK_SPACE, CK_DONE_DATE, CK_DONE_PRIO,
+    CK_PRIO_CASE, CK_PRIO_LATE, CK_PRIO_CTX, CK_NO_DATE, CK_BAD_DATE,
+    CK_NO_TYPE, CK_TYPE_LONG, CK_COUNT
+};
+
+static const char *check_msgs[CK_COUNT] = {
+    [CK_EMPTY]     = "empty line",
+    [CK_LONG]      = "line too long, loads as two items",
+    [CK_CR]        = "carriage return",
+    [CK_SPACE]     = "extra whitespace before the text",
+    [CK_DONE_DATE] = "completed without both dates",
+    [CK_DONE_PRIO] = "priority on a completed item",
+    [CK_PRIO_CASE] = "lowercase priority",
+    [CK_PRIO_LATE] = "priority after the date",
+    [CK_PRIO_CTX]  = "priority after the @context",
+    [CK_NO_DATE]   = "missing date",
+    [CK_BAD_DATE]  = "bad date",
+    [CK_NO_TYPE]   = "missing @context",
+    [CK_TYPE_LONG] = "@context too long, gets truncated",
+};
+
+/* problems --fix leaves to the user: the line is written back as it is */
+#define CK_KEEP (1u << CK_LONG | 1u << CK_TYPE_LONG)
+
+typedef struct {
+    long     line;                      /* within the chunk, from 0 */
+    unsigned bits;                      /* 1 << CK_* */
+} CheckProblem;
+
+typedef struct {
+    const char   *start, *end;
+    long          lines;                /* line breaks in the chunk */
+    CheckProblem *probs;
+    int           n, cap;
+    char         *out;                  /* --fix: the chunk in canonical form */
+    size_t        used, size;
+} CheckChunk;
+
+static CheckChunk *check_chunks = NULL;
+static int         check_nchunks = 0;
+static int         check_next;          /* next chunk to check, taken atomically */
+static bool        check_fix = false;
+static char        check_today[11];
+
+/* YYYY-MM-DD naming a real day; runs for every line, so no sscanf */
+static bool check_date(const char *s, size_t n)
+{
+    static const int mdays[12] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    if (n != 10 || s[4] != '-' || s[7] != '-') return false;
+    for (int i = 0; i < 10; ++i)
+        if (i != 4 && i != 7 && (unsigned)(s[i] - '0') > 9) return false;
+    int y = (s[0] - '0') * 1000 + (s[1] - '0') * 100 + (s[2] - '0') * 10 + (s[3] - '0');
+    int m = (s[5] - '0') * 10 + (s[6] - '0'), d = (s[8] - '0') * 10 + (s[9] - '0');
+    if (m < 1 || m > 12 || d < 1 || d > mdays[m - 1]) return false;
+    return m != 2 || d < 29 || (y % 4 == 0 && (y % 100 != 0 || y % 400 == 0));
+}
+
+static bool check_date_like(const char *s, size_t n)
+{
+    return n >= 6 && isdigit((unsigned char)s[0]) && isdigit((unsigned char)s[3]) &&
+           (s[4] == '-' || s[4] == '/' || s[4] == '.');
+}
+
+/* a date written as 2024/3/7 or 2024.03.07 into out[11] */
+static bool check_repair_date(const char *s, size_t n, char *out)
+{
+    char buf[16], tmp[32];
+    int y, m, d, used = 0;
+    if (n >= sizeof buf) return false;
+    memcpy(buf, s, n);
+    buf[n] = '\0';
+    for (char *c = buf; *c; ++c)
+        if (*c == '/' || *c == '.') *c = '-';
+    if (sscanf(buf, "%4d-%2d-%2d%n", &y, &m, &d, &used) != 3 || used != (int)n) return false;
+    snprintf(tmp, sizeof tmp, "%04d-%02d-%02d", y, m, d);
+    if (!check_date(tmp, strlen(tmp))) return false;
+    memcpy(out, tmp, 11);
+    return true;
+}
+
+static bool check_prio(const char *s, size_t n)
+{
+    return n == 3 && s[0] == '(' && isalpha((unsigned char)s[1]) && s[2] == ')';
+}
+
+/*
+ * Problems of one line (without its '\n') as 1 << CK_* bits. With t, also
+ * the item as it should be written: dates repaired or set to today, the
+ * priority moved to the front, @all where the context is missing.
+ */
+static unsigned check_line(const char *s, size_t n, Todo *t)
+{
+    unsigned bits = 0;
+    if (n >= MAX_LINE - 1) return 1u << CK_LONG;    // fgets splits it
+    if (n && s[n - 1] == '\r') { bits |= 1u << CK_CR; --n; }
+    if (n == 0) return bits | 1u << CK_EMPTY;
+
+    // the header words, with the whitespace before each
+    struct { const char *s; size_t n; int gap; } w[8];
+    const char *end = s + n;
+    int nw = 0, tail = 0;
+    for (const char *p = s; nw < 8; ++nw) {
+        int gap = 0;
+        while (p < end && (*p == ' ' || *p == '\t')) gap += *p++ == ' ' ? 1 : 2;   // a tab is never right
+        if (p == end) { tail = gap; break; }
+        w[nw].gap = gap;
+        w[nw].s = p;
+        while (p < end && *p != ' ' && *p != '\t') ++p;
+        w[nw].n = (size_t)(p - w[nw].s);
+    }
+
+    char done[11] = "", date[11] = "", prio[4] = "";
+    bool completed = false;
+    int k = 0, bad_date = -1;
+
+    if (k < nw && w[k].n == 1 && w[k].s[0] == 'x') {
+        completed = true;
+        k++;
+        if (k < nw && check_date(w[k].s, w[k].n)) {
+            memcpy(done, w[k++].s, 10);
+            if (k < nw && check_date(w[k].s, w[k].n)) memcpy(date, w[k++].s, 10);
+            else { bits |= 1u << CK_DONE_DATE; memcpy(date, done, 11); }
+        } else {
+            bits |= 1u << CK_DONE_DATE;
+            memcpy(done, check_today, 11);
+        }
+    }
+    if (!date[0]) {
+        if (k < nw && check_prio(w[k].s, w[k].n)) memcpy(prio, w[k++].s, 3);
+        if (k < nw && check_date(w[k].s, w[k].n)) {
+            memcpy(date, w[k++].s, 10);
+        } else if (k < nw && check_repair_date(w[k].s, w[k].n, date)) {
+            bits |= 1u << CK_BAD_DATE;
+            k++;
+        } else if (k < nw && check_date_like(w[k].s, w[k].n)) {
+            // kept, as the start of the text
+            bits |= 1u << CK_BAD_DATE;
+            bad_date = k++;
+            memcpy(date, check_today, 11);
+        } else {
+            bits |= 1u << CK_NO_DATE;
+            memcpy(date, check_today, 11);
+        }
+    }
+    if (!prio[0] && k < nw && check_prio(w[k].s, w[k].n)) {
+        bits |= 1u << CK_PRIO_LATE;
+        memcpy(prio, w[k++].s, 3);
+    }
+
+    char type[MAX_TYPE] = "all";
+    if (k < nw && w[k].s[0] == '@' && w[k].n > 1) {
+        size_t len = w[k].n - 1;
+        if (len >= MAX_TYPE) { bits |= 1u << CK_TYPE_LONG; len = MAX_TYPE - 1; }
+        memcpy(type, w[k++].s + 1, len);
+        type[len] = '\0';
+    } else {
+        bits |= 1u << CK_NO_TYPE;
+    }
+    if (!prio[0] && !completed && k < nw && check_prio(w[k].s, w[k].n)) {
+        bits |= 1u << CK_PRIO_CTX;
+        memcpy(prio, w[k++].s, 3);
+    }
+
+    if (prio[0] && islower((unsigned char)prio[1])) {
+        bits |= 1u << CK_PRIO_CASE;
+        prio[1] = (char)toupper((unsigned char)prio[1]);
+    }
+    if (prio[0] && completed) bits |= 1u << CK_DONE_PRIO;
+    for (int i = 0; i <= k && i < nw; ++i)
+        if (w[i].gap != (i > 0)) bits |= 1u << CK_SPACE;
+    if (k >= nw && tail > 1) bits |= 1u << CK_SPACE;       // nntm writes one
+
+    if (t) {
+        memset(t, 0, sizeof *t);
+        t->completed = completed;
+        memcpy(t->completion_date, done, sizeof done);
+        memcpy(t->date, date, sizeof date);
+        memcpy(t->type, type, sizeof type);
+        int len = k < nw ? (int)(end - w[k].s) : 0;
+        if (bad_date >= 0)
+            snprintf(t->text, sizeof t->text, "%.*s%s%.*s", (int)w[bad_date].n, w[bad_date].s,
+                     len ? " " : "", len, k < nw ? w[k].s : "");
+        else
+            snprintf(t->text, sizeof t->text, "%.*s", len, k < nw ? w[k].s : "");
+        if (completed && prio[0]) {
+            // as toggling does: the priority survives as a tag
+            char tag[8];
+            snprintf(tag, sizeof tag, " pri:%c", prio[1]);
+            if (!strstr(t->text, tag + 1) && strlen(t->text) + strlen(tag) < MAX_LINE)
+                strcat(t->text, t->text[0] ? tag : tag + 1);
+        } else if (!completed) {
+            memcpy(t->priority, prio, sizeof prio);
+        }
+    }
+    return bits;
+}
+
+static void check_out(CheckChunk *c, const char *s, size_t n)
+{
+    if (c->used + n + 1 > c->size) {
+        c->size = (c->used + n + 1) * 2;
+        c->out = realloc(c->out, c->size);
+        if (!c->out) { perror("realloc"); exit(1); }
+    }
+    memcpy(c->out + c->used, s, n);
+    c->used += n;
+    c->out[c->used++] = '\n';
+}
+
+static void check_chunk(CheckChunk *c)
+{
+    for (const char *p = c->start; p < c->end; c->lines++) {
+        const char *nl = memchr(p, '\n', (size_t)(c->end - p));
+        const char *le = nl ? nl : c->end;
+        Todo t;
+        unsigned bits = check_line(p, (size_t)(le - p), check_fix ? &t : NULL);
+
+        if (bits) {
+            if (c->n == c->cap) {
+                c->cap = c->cap ? c->cap * 2 : 16;
+                c->probs = realloc(c->probs, (size_t)c->cap * sizeof *c->probs);
+                if (!c->probs) { perror("realloc"); exit(1); }
+            }
+            c->probs[c->n++] = (CheckProblem){ c->lines, bits };
+        }
+        if (check_fix && !(bits & 1u << CK_EMPTY)) {
+            if (!bits || bits & CK_KEEP) {
+                check_out(c, p, (size_t)(le - p));
+            } else {
+                char buf[MAX_LINE * 2];
+                int len = format_todo_line(buf, sizeof buf, &t);
+                check_out(c, buf, (size_t)len - 1);
+            }
+        }
+        if (!nl) break;
+        p = nl + 1;
+    }
+}
+
+static void *check_worker(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        int i = __atomic_fetch_add(&check_next, 1, __ATOMIC_RELAXED);
+        if (i >= check_nchunks) return NULL;
+        check_chunk(&check_chunks[i]);
+    }
+}
+
+static int run_check(int argc, char **argv)
+{
+    if (argc < 3 || argc > 4 || (argc == 4 && strcmp(argv[3], "--fix") != 0)) {
+        fprintf(stderr, "Usage: %s check <todo-file> [--fix]\n", argv[0]);
+        return 2;
+    }
+    const char *path = argv[2];
+    check_fix = argc == 4;
+    if (crypt_sealed(path)) {
+        fprintf(stderr, "%s is encrypted; open it with --decrypt first\n", path);
+        return 2;
+    }
+    time_t now = time(NULL);
+    strftime(check_today, sizeof check_today, "%Y-%m-%d", localtime(&now));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { perror(path); return 2; }
+    struct stat st;
+    if (fstat(fd, &st) != 0) { perror(path); close(fd); return 2; }
+    size_t size = (size_t)st.st_size;
+    if (size == 0) { close(fd); return 0; }
+    const char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) { perror(path); return 2; }
+    madvise((void *)map, size, MADV_SEQUENTIAL);
+
+    // a few chunks per thread, so an unlucky one does not hold up the rest
+    size_t step = size / (size_t)(pool_threads() * 4);
+    if (step < 64 * 1024) step = 64 * 1024;
+    const char *end = map + size;
+    for (const char *p = map; p < end; ) {
+        const char *q = (size_t)(end - p) > step ? memchr(p + step, '\n', (size_t)(end - p - step)) : NULL;
+        q = q ? q + 1 : end;
+        check_chunks = realloc(check_chunks, (size_t)(check_nchunks + 1) * sizeof *check_chunks);
+        if (!check_chunks) { perror("realloc"); return 2; }
+        check_chunks[check_nchunks++] = (CheckChunk){ .start = p, .end = q };
+        p = q;
+    }
+    check_next = 0;
+    run_pool(check_worker, check_nchunks);
+
+    long first = 1, lines = 0;
+    int bad = 0, unfixed = 0;
+    for (int i = 0; i < check_nchunks; ++i) {
+        const CheckChunk *c = &check_chunks[i];
+        for (int k = 0; k < c->n; ++k) {
+            printf("%s:%ld:", path, first + c->probs[k].line);
+            const char *sep = " ";
+            for (int b = 0; b < CK_COUNT; ++b) {
+                if (!(c->probs[k].bits & 1u << b)) continue;
+                printf("%s%s", sep, check_msgs[b]);
+                sep = ", ";
+            }
+            putchar('\n');
+            if (c->probs[k].bits & CK_KEEP) unfixed++;
+        }
+        bad += c->n;
+        first += c->lines;
+        lines += c->lines;
+    }
+    if (lines > MAX_TODOS)
+        printf("%s: %ld lines, only the first %d are loaded\n", path, lines, MAX_TODOS);
+
+    int status = bad > 0 ? 1 : 0;
+    if (check_fix && bad > unfixed) {
+        Replace r;
+        if (!replace_open(&r, path, ".check.tmp")) { perror(path); return 2; }
+        for (int i = 0; i < check_nchunks; ++i)
+            fwrite(check_chunks[i].out, 1, check_chunks[i].used, r.f);
+        if (!replace_commit(&r)) {
+            perror("check write");
+            return 2;
+        }
+        fprintf(stderr, "%s: fixed %d of %d lines with problems\n", path, bad - unfixed, bad);
+        status = unfixed > 0 ? 1 : 0;
+    } else {
+        fprintf(stderr, "%s: %ld lines, %d with problems\n", path, lines, bad);
+    }
+    munmap((void *)map, size);
+    return status;
+}
+
+/* ───────────────────────────────────────────────────────────── diff ── */
+
+/*
+ * `nntm diff <old> <new>` reports what happened to items rather than to
+ * lines. Items are paired by their id: tag, then by a hash of their text
+ * with case, spacing and bookkeeping tags (pri:, escalated:) ignored, and
+ * what is left over by similar wording among items of the same date and
+ * context. Each pairing pass is a hash lookup per item, so the whole diff
+ * stays close to linear; lines are parsed in parallel chunks.
+ */
+#define DIFF_CHUNK     4096          /* lines per parse job */
+#define DIFF_CANDIDATE 16            /* items compared per leftover when looking for edits */
+#define DIFF_WORDS     64
+
+typedef struct {
+    char     *line;
+    uint64_t  id;                    /* hash of the id: tag, 0 if none */
+    uint64_t  norm;                  /* text, case and spacing folded */
+    uint64_t  text;                  /* text as written, spacing folded */
+    uint64_t  group;                 /* creation date and context */
+    uint64_t  state;                 /* completion, priority, context, date */
+    int       next;                  /* next item with the same key, -1 */
+    int       match;                 /* paired item in the other file, -1 */
+} DiffItem;
+
+typedef struct {
+    char     *buf;
+    DiffItem *items;
+    int       n;
+} DiffFile;
+
+typedef struct {
+    uint64_t key;
+    int      head;                   /* first item with key, -1 if empty */
+} DiffSlot;
+
+static DiffFile diff_files[2];
+static int      diff_next;           /* next parse job, taken atomically */
+static int      diff_jobs[2];
+
+/* a word that is only bookkeeping: pri:X, escalated:DATE, id:KEY */
+static bool diff_ignored(const char *w, size_t n)
+{
+    return (n > 4 && strncmp(w, "pri:", 4) == 0) ||
+           (n > 10 && strncmp(w, "escalated:", 10) == 0) ||
+           (n > 3 && strncmp(w, "id:", 3) == 0);
+}
+
+/* text without bookkeeping tags, single-spaced, optionally lowercased */
+static size_t diff_fold(const char *text, char *out, size_t size, bool fold_case)
+{
+    size_t len = 0;
+    for (const char *p = text; *p; ) {
+        while (isspace((unsigned char)*p)) ++p;
+        size_t n = strcspn(p, " \t\r\n");
+        if (n == 0) break;
+        if (!diff_ignored(p, n) && len + n + 1 < size) {
+            if (len) out[len++] = ' ';
+            for (size_t i = 0; i < n; ++i)
+                out[len++] = fold_case ? (char)tolower((unsigned char)p[i]) : p[i];
+        }
+        p += n;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+/* priority letter, also where completion moved it into a pri: tag */
+static char diff_priority(const Todo *t)
+{
+    if (t->priority[0] == '(') return t->priority[1];
+    const char *pri = strstr(t->text, " pri:");
+    return pri && isalpha((unsigned char)pri[5]) && (pri[6] == '\0' || isspace((unsigned char)pri[6])) ? pri[5] : 0;
+}
+
+static void diff_hash(DiffItem *d)
+{
+    Todo t;
+    char buf[MAX_LINE], key[ITEM_KEY];
+    parse_todo_line(d->line, &t);
+    d->id = item_tag(t.text, "id", key) ? hash64(key, strlen(key)) | 1 : 0;
+    d->norm = hash64(buf, diff_fold(t.text, buf, sizeof buf, true));
+    d->text = hash64(buf, diff_fold(t.text, buf, sizeof buf, false));
+
+    int len = snprintf(buf, sizeof buf, "%s %s", t.date, t.type);
+    d->group = hash64(buf, (size_t)len);
+    len = snprintf(buf, sizeof buf, "%d %c %s %s %s", t.completed, diff_priority(&t) ? diff_priority(&t) : '-',
+                   t.type, t.date, t.completion_date);
+    d->state = hash64(buf, (size_t)len);
+    d->next = d->match = -1;
+}
+
+static void *diff_worker(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        int job = __atomic_fetch_add(&diff_next, 1, __ATOMIC_RELAXED);
+        if (job >= diff_jobs[0] + diff_jobs[1]) return NULL;
+        DiffFile *f = &diff_files[job >= diff_jobs[0]];
+        int first = (job >= diff_jobs[0] ? job - diff_jobs[0] : job) * DIFF_CHUNK;
+        int last = first + DIFF_CHUNK < f->n ? first + DIFF_CHUNK : f->n;
+        for (int i = first; i < last; ++i) diff_hash(&f->items[i]);
+    }
+}
+
+/* the whole file (a pipe from `<(git show ...)` works too), one item per non-empty line */
+static bool diff_read(const char *path, DiffFile *f)
+{
+    if (crypt_sealed(path)) {
+        fprintf(stderr, "%s is encrypted; open it with --decrypt first\n", path);
+        return false;
+    }
+    FILE *in = fopen(path, "r");
+    if (!in) { perror(path); return false; }
+    size_t len = 0, cap = 1 << 16;
+    f->buf = malloc(cap + 1);
+    for (size_t got; f->buf && (got = fread(f->buf + len, 1, cap - len, in)) > 0; ) {
+        len += got;
+        if (len == cap) f->buf = realloc(f->buf, (cap *= 2) + 1);
+    }
+    fclose(in);
+    if (!f->buf) { perror("malloc"); return false; }
+    f->buf[len] = '\0';
+
+    int n = 0, icap = 0;
+    for (char *p = f->buf; *p; ) {
+        char *nl = strchr(p, '\n');
+        if (nl) *nl = '\0';
+        size_t l = strlen(p);
+        if (l > 0 && p[l - 1] == '\r') p[--l] = '\0';
+        if (l > 0) {
+            if (n == icap) {
+                icap = icap ? icap * 2 : 1024;
+                f->items = realloc(f->items, (size_t)icap * sizeof *f->items);
+                if (!f->items) { perror("realloc"); return false; }
+            }
+            f->items[n++].line = p;
+        }
+        if (!nl) break;
+        p = nl + 1;
+    }
+    f->n = n;
+    return true;
+}
+
+/* hash table from key to the chain of items of f carrying it */
+static DiffSlot *diff_index(DiffFile *f, size_t offset, int *mask)
+{
+    int cap = 1024;
+    while (cap < 2 * f->n) cap *= 2;
+    DiffSlot *slots = malloc((size_t)cap * sizeof *slots);
+    if (!slots) return NULL;
+    for (int i = 0; i < cap; ++i) slots[i] = (DiffSlot){ 0, -1 };
+    // inserted back to front, so chains run in file order
+    for (int i = f->n - 1; i >= 0; --i) {
+        uint64_t key = *(uint64_t *)((char *)&f->items[i] + offset);
+        if (!key) continue;
+        int k = (int)(key & (uint64_t)(cap - 1));
+        while (slots[k].head >= 0 && slots[k].key != key) k = (k + 1) & (cap - 1);
+        f->items[i].next = slots[k].head;
+        slots[k] = (DiffSlot){ key, i };
+    }
+    *mask = cap - 1;
+    return slots;
+}
+
+static DiffSlot *diff_slot(DiffSlot *slots, int mask, uint64_t key)
+{
+    int k = (int)(key & (uint64_t)mask);
+    while (slots[k].head >= 0 && slots[k].key != key) k = (k + 1) & mask;
+    return slots[k].head >= 0 ? &slots[k] : NULL;
+}
+
+/* pair each unpaired item of b with the first unpaired item of a sharing the key */
+static void diff_pair(DiffFile *a, DiffFile *b, size_t offset)
+{
+    int mask;
+    DiffSlot *slots = diff_index(a, offset, &mask);
+    if (!slots) return;
+    for (int j = 0; j < b->n; ++j) {
+        DiffItem *d = &b->items[j];
+        uint64_t key = *(uint64_t *)((char *)d + offset);
+        DiffSlot *slot = key && d->match < 0 ? diff_slot(slots, mask, key) : NULL;
+        if (!slot) continue;
+        // paired heads are dropped for good, so long runs of duplicates stay linear
+        while (slot->head >= 0 && a->items[slot->head].match >= 0) slot->head = a->items[slot->head].next;
+        int seen = 0;
+        for (int i = slot->head; i >= 0 && seen < DIFF_CANDIDATE; i = a->items[i].next, ++seen) {
+            DiffItem *c = &a->items[i];
+            if (c->match >= 0 || (c->id && d->id && c->id != d->id)) continue;   // two different items
+            c->match = j;
+            d->match = i;
+            break;
+        }
+    }
+    free(slots);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* hashes of the folded words of line's text, sorted */
+static int diff_words(const char *line, uint64_t *words)
+{
+    Todo t;
+    char buf[MAX_LINE];
+    parse_todo_line(line, &t);
+    diff_fold(t.text, buf, sizeof buf, true);
+    int n = 0;
+    for (char *save = NULL, *w = strtok_r(buf, " ", &save); w && n < DIFF_WORDS; w = strtok_r(NULL, " ", &save))
+        words[n++] = hash64(w, strlen(w));
+    qsort(words, (size_t)n, sizeof *words, cmp_u64);
+    return n;
+}
+
+typedef struct {
+    uint64_t group;
+    int      item;
+} DiffLeft;
+
+static int cmp_diff_left(const void *a, const void *b)
+{
+    const DiffLeft *x = a, *y = b;
+    if (x->group != y->group) return (x->group > y->group) - (x->group < y->group);
+    return x->item - y->item;
+}
+
+/*
+ * Leftovers of the same date and context whose words mostly agree are one
+ * edited item. The old leftovers are sorted by group and position. A new
+ * leftover is expected where the item before it went, offset by the
+ * distance to it, and only a window of its group around that spot is
+ * compared; both files mostly keep their order.
+ */
+static void diff_pair_edits(DiffFile *a, DiffFile *b)
+{
+    int n = 0;
+    DiffLeft *left = malloc(((size_t)a->n + 1) * sizeof *left);
+    int *group_end = malloc(((size_t)a->n + 1) * sizeof *group_end);
+    if (!left || !group_end) { free(left); free(group_end); return; }
+    for (int i = 0; i < a->n; ++i)
+        if (a->items[i].match < 0) left[n++] = (DiffLeft){ a->items[i].group, i };
+    qsort(left, (size_t)n, sizeof *left, cmp_diff_left);
+
+    int cap = 1024, mask;
+    while (cap < 2 * n) cap *= 2;
+    mask = cap - 1;
+    DiffSlot *slots = malloc((size_t)cap * sizeof *slots);
+    if (!slots) { free(left); free(group_end); return; }
+    for (int k = 0; k < cap; ++k) slots[k] = (DiffSlot){ 0, -1 };
+    for (int x = n - 1; x >= 0; --x) {
+        group_end[x] = x + 1 < n && left[x + 1].group == left[x].group ? group_end[x + 1] : x + 1;
+        if (x > 0 && left[x - 1].group == left[x].group) continue;
+        int k = (int)(left[x].group & (uint64_t)mask);
+        while (slots[k].head >= 0) k = (k + 1) & mask;
+        slots[k] = (DiffSlot){ left[x].group, x };
+    }
+
+    uint64_t wb[DIFF_WORDS], wa[DIFF_WORDS];
+    int anchor_b = -1, anchor_a = -1;         /* last paired new item and its partner */
+    for (int j = 0; j < b->n; ++j) {
+        DiffItem *d = &b->items[j];
+        if (d->match >= 0) { anchor_b = j; anchor_a = d->match; continue; }
+        DiffSlot *slot = diff_slot(slots, mask, d->group);
+        if (!slot) continue;
+        int start = slot->head, end = group_end[start];
+
+        // first leftover at or after the expected position
+        int expect = anchor_b >= 0 ? anchor_a + (j - anchor_b) : j;
+        int lo = start, hi = end;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (left[mid].item < expect) lo = mid + 1; else hi = mid;
+        }
+        int from = lo - DIFF_CANDIDATE / 2 > start ? lo - DIFF_CANDIDATE / 2 : start;
+        int to = from + DIFF_CANDIDATE < end ? from + DIFF_CANDIDATE : end;
+
+        int nb = diff_words(d->line, wb), best = -1, best_dist = 0;
+        double best_score = 0.5;
+        for (int x = from; x < to; ++x) {
+            DiffItem *c = &a->items[left[x].item];
+            if (c->match >= 0 || (c->id && d->id)) continue;
+            int na = diff_words(c->line, wa), common = 0;
+            for (int u = 0, v = 0; u < nb && v < na; ) {
+                if (wb[u] == wa[v]) { ++common; ++u; ++v; }
+                else if (wb[u] < wa[v]) ++u;
+                else ++v;
+            }
+            double score = na + nb ? 2.0 * common / (na + nb) : 0;
+            int dist = abs(left[x].item - expect);
+            if (score > best_score || (score == best_score && best >= 0 && dist < best_dist)) {
+                best_score = score;
+                best = x;
+                best_dist = dist;
+            }
+        }
+        if (best >= 0) {
+            a->items[left[best].item].match = j;
+            d->match = left[best].item;
+            anchor_b = j;
+            anchor_a = d->match;
+        }
+    }
+    free(slots);
+    free(left);
+    free(group_end);
+}
+
+enum { DF_ADDED, DF_REMOVED, DF_COMPLETED, DF_REOPENED, DF_PRIORITY, DF_CONTEXT, DF_DATE, DF_EDITED, DF_COUNT };
+static const char *diff_names[DF_COUNT] = {
+    "added", "removed", "completed", "reopened", "reprioritized", "retyped", "redated", "edited"
+};
+
+/* print what changed between a paired old and new item */
+static void diff_report(const DiffItem *old, const DiffItem *new, int *counts)
+{
+    Todo a, b;
+    parse_todo_line(old->line, &a);
+    parse_todo_line(new->line, &b);
+    printf("~ %s\n", new->line);
+
+    if (!a.completed && b.completed) {
+        printf("    completed %s\n", b.completion_date);
+        counts[DF_COMPLETED]++;
+    } else if (a.completed && !b.completed) {
+        printf("    reopened\n");
+        counts[DF_REOPENED]++;
+    } else if (a.completed && strcmp(a.completion_date, b.completion_date) != 0) {
+        printf("    completed %s -> %s\n", a.completion_date, b.completion_date);
+        counts[DF_DATE]++;
+    }
+    char pa = diff_priority(&a), pb = diff_priority(&b);
+    if (pa != pb) {
+        printf("    priority %s%c%s -> %s%c%s\n", pa ? "(" : "", pa ? pa : '-', pa ? ")" : "",
+               pb ? "(" : "", pb ? pb : '-', pb ? ")" : "");
+        counts[DF_PRIORITY]++;
+    }
+    if (strcmp(a.type, b.type) != 0) {
+        printf("    context @%s -> @%s\n", a.type, b.type);
+        counts[DF_CONTEXT]++;
+    }
+    if (strcmp(a.date, b.date) != 0) {
+        printf("    date %s -> %s\n", a.date, b.date);
+        counts[DF_DATE]++;
+    }
+    if (old->text != new->text) {
+        char buf[MAX_LINE];
+        diff_fold(a.text, buf, sizeof buf, false);
+        printf("    was: %s\n", buf);
+        counts[DF_EDITED]++;
+    }
+}
+
+static int run_diff(int argc, char **argv)
+{
+    if (argc != 4) {
+        fprintf(stderr, "Usage: %s diff <old-file> <new-file>\n", argv[0]);
+        return 2;
+    }
+    DiffFile *a = &diff_files[0], *b = &diff_files[1];
+    if (!diff_read(argv[2], a) || !diff_read(argv[3], b)) return 2;
+
+    diff_jobs[0] = (a->n + DIFF_CHUNK - 1) / DIFF_CHUNK;
+    diff_jobs[1] = (b->n + DIFF_CHUNK - 1) / DIFF_CHUNK;
+    diff_next = 0;
+    if (diff_jobs[0] + diff_jobs[1] > 0) run_pool(diff_worker, diff_jobs[0] + diff_jobs[1]);
+
+    diff_pair(a, b, offsetof(DiffItem, id));
+    diff_pair(a, b, offsetof(DiffItem, norm));
+    diff_pair_edits(a, b);
+
+    int counts[DF_COUNT] = { 0 };
+    for (int j = 0; j < b->n; ++j) {
+        const DiffItem *d = &b->items[j];
+        if (d->match < 0) {
+            printf("+ %s\n", d->line);
+            counts[DF_ADDED]++;
+        } else if (d->text != a->items[d->match].text || d->state != a->items[d->match].state) {
+            diff_report(&a->items[d->match], d, counts);
+        }
+    }
+    for (int i = 0; i < a->n; ++i) {
+        if (a->items[i].match >= 0) continue;
+        printf("- %s\n", a->items[i].line);
+        counts[DF_REMOVED]++;
+    }
+
+    int total = 0;
+    fprintf(stderr, "%s -> %s:", argv[2], argv[3]);
+    for (int k = 0; k < DF_COUNT; ++k) {
+        if (!counts[k]) continue;
+        fprintf(stderr, "%s %d %s", total ? "," : "", counts[k], diff_names[k]);
+        total += counts[k];
+    }
+    fprintf(stderr, "%s\n", total ? "" : " no changes");
+    return total > 0 ? 1 : 0;
+}
+
+/* ──────────────────────────────────────────────────────────── notes ── */
+
+/*
+ * Notes live in todo.notes next to the todo file as a log of records
+ *
+ *     @@ <key> <length>\n<length bytes>\n
+ *
+ * appended on every edit; the last record of a key wins and length 0
+ * deletes. An item points at its note with an "id:" tag, added when its
+ * first note is written. Nothing is read at load: the file is mapped and
+ * its record headers indexed the first time a note is opened, and it is
+ * rewritten without superseded records once those outweigh the live ones.
+ */
+typedef struct {
+    char key[ITEM_KEY];             /* "" for an empty slot */
+    long off;                       /* body offset in the file */
+    long len;                       /* body length, 0 if deleted */
+    long rec;                       /* whole record length */
+} NoteEntry;
+
+static NoteEntry *note_table = NULL;
+static size_t     note_cap = 0, note_used = 0;
+static long       note_size = -1;   /* file size the index covers, -1: not built */
+static long       note_dead = 0;    /* bytes of superseded records */
+static char       note_path[PATH_MAX];
+
+static NoteEntry *note_find(const char *key, bool create)
+{
+    if (create && (note_used + 1) * 2 > note_cap) {
+        size_t old_cap = note_cap;
+        NoteEntry *old = note_table;
+        note_cap = note_cap ? note_cap * 2 : 256;
+        note_table = calloc(note_cap, sizeof *note_table);
+        if (!note_table) { perror("calloc"); exit(1); }
+        for (size_t i = 0; i < old_cap; ++i) {
+            if (!old[i].key[0]) continue;
+            size_t j = hash_str(old[i].key) & (note_cap - 1);
+            while (note_table[j].key[0]) j = (j + 1) & (note_cap - 1);
+            note_table[j] = old[i];
+        }
+        free(old);
+    }
+    if (!note_cap) return NULL;
+
+    size_t i = hash_str(key) & (note_cap - 1);
+    for (; note_table[i].key[0]; i = (i + 1) & (note_cap - 1))
+        if (strcmp(note_table[i].key, key) == 0) return &note_table[i];
+    if (!create) return NULL;
+    snprintf(note_table[i].key, ITEM_KEY, "%s", key);
+    note_used++;
+    return &note_table[i];
+}
+
+/* a record for key was written at off; the one it replaces is now dead */
+static void note_record(const char *key, long off, long len, long rec)
+{
+    NoteEntry *e = note_find(key, true);
+    if (e->rec) note_dead += e->rec;
+    e->off = off;
+    e->len = len;
+    e->rec = rec;
+}
+
+/* build the index if the file changed since it was built */
+static void notes_index(void)
+{
+    sidecar_path(note_path, sizeof note_path, "todo.notes");
+    struct stat st;
+    long size = stat(note_path, &st) == 0 ? (long)st.st_size : 0;
+    if (size == note_size) return;
+
+    free(note_table);
+    note_table = NULL;
+    note_cap = note_used = 0;
+    note_dead = 0;
+    note_size = size;
+    if (size == 0) return;
+
+    int fd = open(note_path, O_RDONLY);
+    if (fd < 0) return;
+    const char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return;
+
+    // only the headers are looked at, bodies are skipped by length
+    for (long pos = 0; pos + 3 < size && memcmp(map + pos, "@@ ", 3) == 0; ) {
+        const char *nl = memchr(map + pos, '\n', size - pos);
+        char key[ITEM_KEY];
+        long len;
+        if (!nl || nl - (map + pos) > 64) break;
+        char hdr[80];
+        memcpy(hdr, map + pos, nl - (map + pos));
+        hdr[nl - (map + pos)] = '\0';
+        if (sscanf(hdr, "@@ %15s %ld", key, &len) != 2 || len < 0) break;
+
+        long body = nl + 1 - map;
+        if (body + len + 1 > size) break;
+        note_record(key, body, len, body + len + 1 - pos);
+        pos = body + len + 1;
+    }
+    munmap((void *)map, size);
+}
+
+/* the note stored under key, malloc'ed and NUL terminated; NULL if none */
+static char *notes_read(const char *key)
+{
+    notes_index();
+    NoteEntry *e = note_find(key, false);
+    if (!e || e->len == 0) return NULL;
+
+    char *body = malloc(e->len + 1);
+    int fd = open(note_path, O_RDONLY);
+    if (!body || fd < 0 || pread(fd, body, e->len, e->off) != e->len) {
+        if (fd >= 0) close(fd);
+        free(body);
+        return NULL;
+    }
+    close(fd);
+    body[e->len] = '\0';
+    return body;
+}
+
+/* keep only the live records, swapped in with one rename */
+static void notes_compact(void)
+{
+    Replace r;
+    int in = open(note_path, O_RDONLY);
+    if (in < 0) return;
+    if (!replace_open(&r, note_path, ".tmp")) { close(in); return; }
+    FILE *out = r.f;
+
+    bool ok = true;
+    for (size_t i = 0; i < note_cap && ok; ++i) {
+        NoteEntry *e = &note_table[i];
+        if (!e->key[0] || e->len == 0) continue;
+        char *body = malloc(e->len);
+        ok = body && pread(in, body, e->len, e->off) == e->len;
+        if (ok) {
+            fprintf(out, "@@ %s %ld\n", e->key, e->len);
+            fwrite(body, 1, e->len, out);
+            fputc('\n', out);
+        }
+        free(body);
+    }
+    close(in);
+    if (!ok) { replace_abort(&r); return; }
+    if (!replace_commit(&r)) return;
+    note_size = -1;
+    notes_index();
+}
+
+/* append a record for key; an empty body deletes the note */
+static bool notes_write(const char *key, const char *body, long len)
+{
+    notes_index();
+    int fd = open(note_path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd < 0) return false;
+
+    char hdr[64];
+    int hlen = snprintf(hdr, sizeof hdr, "@@ %s %ld\n", key, len);
+    bool ok = write(fd, hdr, hlen) == hlen &&
+              (len == 0 || write(fd, body, len) == len) &&
+              write(fd, "\n", 1) == 1;
+    close(fd);
+    if (!ok) { note_size = -1; return false; }
+
+    note_record(key, note_size + hlen, len, hlen + len + 1);
+    note_size += hlen + len + 1;
+
+    if (note_dead > 64 * 1024 && note_dead * 2 > note_size) notes_compact();
+    return true;
+}
+
+/* give t a stable "id:" tag unless it has one; false if the text has no room. The caller saves */
+static bool item_key_assign(Todo *t, char *key)
+{
+    if (item_key_of(t, key)) return true;
+
+    static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    notes_index();
+    do {
+        // a letter first, so the value never reads as a numeric tag
+        unsigned long v = (unsigned long)time(NULL) * 2654435761u ^ (unsigned long)rand();
+        key[0] = 'n';
+        for (int i = 1; i < 8; ++i, v /= 36) key[i] = digits[v % 36];
+        key[8] = '\0';
+    } while (note_find(key, false) || tree_lookup(key) >= 0);
+
+    if (!set_text_tag(t->text, "id", key)) return false;
+    todo_changed(t);
+    return true;
+}
+
+/* ───────────────────────────────────────────── logic ── */
+
+/* `z`: fold or unfold the selected item's subtree */
+static void toggle_fold(void)
+{
+    Todo *t = view_at(selected_index);
+    if (!t || tree_total[t->id] == 0) return;
+    tree_folded[t->id] = !tree_folded[t->id];
+    tree_revision++;
+}
+
+/*
+ * `>` makes the selected item a child of the sibling above it, `<` moves it
+ * up to its grandparent (or out of the tree). Only tags change: the parent
+ * gets an "id:" tag if it has none, the child a "parent:" tag.
+ */
+static void reparent_selected(bool indent)
+{
+    Todo *t = view_at(selected_index);
+    if (!t) return;
+
+    Todo *parent = NULL;
+    if (indent) {
+        int depth = view_depth(selected_index), k = selected_index - 1;
+        while (k >= 0 && view_depth(k) > depth) --k;
+        if (k < 0 || view_depth(k) != depth) return;
+        parent = view_at(k);
+    } else {
+        if (tree_parent[t->id] < 0) return;
+        parent = todo_by_id(tree_parent[tree_parent[t->id]]);
+    }
+
+    char text[MAX_LINE];
+    snprintf(text, sizeof text, "%s", t->text);
+    remove_text_tag(text, "parent");
+    if (parent) {
+        char key[ITEM_KEY];
+        // no room for either tag: stays where it is
+        if (!item_key_assign(parent, key) || !set_text_tag(text, "parent", key)) return;
+        if (tree_folded[parent->id]) {
+            tree_folded[parent->id] = false;
+            tree_revision++;
+        }
+    }
+    memcpy(t->text, text, sizeof text);
+    todo_changed(t);
+    save_todos_to_file();
+    restore_selection(t->id);
+}
+
+/*
+ * `R` replaces a literal string in item text, over the items in view
+ * (context and filter, folded subtasks included) or over the whole list.
+ * Candidates come from the trigram index. Only items that change go
+ * through todo_changed, and the lot is one save, one hook call and one
+ * undo entry.
+ */
+static struct {
+    int    n;
+    int    ids[MAX_TODOS];
+    char (*before)[MAX_LINE], (*after)[MAX_LINE];
+} undo_edit;                    /* the last bulk edit, `u` flips it */
+
+/* text with every from replaced by to; occurrences, -1 if it gets too long */
+static int replace_all(const char *text, const char *from, const char *to, char *out)
+{
+    size_t flen = strlen(from), tlen = strlen(to), used = 0;
+    int n = 0;
+    for (const char *p = text;; ++n) {
+        const char *q = strstr(p, from);
+        size_t keep = q ? (size_t)(q - p) : strlen(p);
+        if (used + keep + (q ? tlen : 0) >= MAX_LINE) return -1;
+        memcpy(out + used, p, keep);
+        used += keep;
+        if (!q) break;
+        memcpy(out + used, to, tlen);
+        used += tlen;
+        p = q + flen;
+    }
+    out[used] = '\0';
+    return n;
+}
+
+static bool replace_in_view(const Todo *t)
+{
+    if (strcmp(types[selected_type], "all") != 0 && type_index(t->type) != selected_type)
+        return false;
+    return !filter_on || re_test(&filter_re, t->text);
+}
+
+/* ids of the items containing from into ids; occurrences into *count */
+static int replace_targets(const char *from, bool all, int *ids, int *count)
+{
+    static char lit[1][MAX_LINE];
+    snprintf(lit[0], MAX_LINE, "%s", from);
+    uint64_t cand[TRI_WORDS];
+    tri_candidates(lit, 1, cand);
+
+    int n = 0;
+    *count = 0;
+    for (int w = 0; w < TRI_WORDS; ++w) {
+        for (uint64_t bits = cand[w]; bits; bits &= bits - 1) {
+            Todo *t = todo_by_id(w * 64 + __builtin_ctzll(bits));
+            if (!t || (!all && !replace_in_view(t))) continue;
+            int k = 0;
+            for (const char *p = strstr(t->text, from); p; p = strstr(p + strlen(from), from)) ++k;
+            if (k == 0) continue;
+            ids[n++] = t->id;
+            *count += k;
+        }
+    }
+    return n;
+}
+
+/* one save and one hook call for a bulk edit */
+static void bulk_edit_done(Todo **items, int n)
+{
+    if (n == 0) return;
+    save_todos_to_file();
+    run_hooks(EV_REPLACE, items, n);
+}
+
+static void replace_apply(const char *from, const char *to, const int *ids, int n)
+{
+    static Todo *items[MAX_TODOS];
+    if (!undo_edit.before) {
+        undo_edit.before = malloc(sizeof *undo_edit.before * MAX_TODOS);
+        undo_edit.after = malloc(sizeof *undo_edit.after * MAX_TODOS);
+    }
+
+    int m = 0;
+    for (int i = 0; i < n; ++i) {
+        Todo *t = todo_by_id(ids[i]);
+        char out[MAX_LINE];
+        if (!t || replace_all(t->text, from, to, out) <= 0) continue;   // none, or too long
+        undo_edit.ids[m] = t->id;
+        memcpy(undo_edit.before[m], t->text, MAX_LINE);
+        snprintf(t->text, sizeof t->text, "%s", out);
+        memcpy(undo_edit.after[m], t->text, MAX_LINE);
+        todo_changed(t);
+        items[m++] = t;
+    }
+    undo_edit.n = m;
+    bulk_edit_done(items, m);
+}
+
+/* `u`: revert the last bulk edit, again to redo it; items edited since stay */
+static void undo_last_edit(void)
+{
+    static Todo *items[MAX_TODOS];
+    int m = 0;
+    for (int i = 0; i < undo_edit.n; ++i) {
+        Todo *t = todo_by_id(undo_edit.ids[i]);
+        if (!t || strcmp(t->text, undo_edit.after[i]) != 0) continue;
+        memcpy(t->text, undo_edit.before[i], MAX_LINE);
+        todo_changed(t);
+        items[m++] = t;
+    }
+    char (*swap)[MAX_LINE] = undo_edit.before;
+    undo_edit.before = undo_edit.after;
+    undo_edit.after = swap;
+    bulk_edit_done(items, m);
+}
+
+static void prompt_replace(void)
+{
+    static int ids[2][MAX_TODOS];
+    char from[MAX_LINE], to[MAX_LINE];
+    prompt_line("replace: ", from, sizeof from, false);
+    if (!from[0]) return;
+    prompt_line("with: ", to, sizeof to, false);
+
+    // preview: what ENTER (this view) and `a` (everything) would change
+    int count[2], n[2];
+    n[0] = replace_targets(from, false, ids[0], &count[0]);
+    n[1] = replace_targets(from, true, ids[1], &count[1]);
+    move(LINES - 1, 0);
+    clrtoeol();
+    attron(COLOR_PAIR(2) | A_BOLD);
+    printw("replace: ");
+    attroff(COLOR_PAIR(2) | A_BOLD);
+    printw("%d in %d items here (ENTER), %d in %d in all contexts (a), ESC cancels",
+           count[0], n[0], count[1], n[1]);
+    refresh();
+
+    int ch = getch();
+    int scope = ch == '\n' || ch == KEY_ENTER ? 0 : ch == 'a' ? 1 : -1;
+    if (scope < 0) return;
+    int sel = selected_id();
+    replace_apply(from, to, ids[scope], n[scope]);
+    restore_selection(sel);
+}
+
+/*
+ * Apply every escalation whose day has come. Runs on load and when the
+ * main loop wakes up, so a day rollover is picked up within a minute;
+ * all changes go out in one save and one hook call.
+ */
+static void escalate_due_items(void)
+{
+    static Todo *changed[MAX_TODOS];
+    int today = today_number(), n = 0;
+
+    for (int id; (id = esc_pending(today)) >= 0; ) {
+        Todo *t = todo_by_id(id);
+        ih_remove(&esc_heap, id);
+        if (!t) continue;
+
+        int prio = t->priority[0] == '(' ? toupper((unsigned char)t->priority[1]) : 0;
+        if (prio < 'A' || prio > 'Z') prio = 0;
+        int was = prio;
+
+        if (esc_age_days > 0 && prio > 'A' && esc_tag_fits(t->text)) {
+            int base = tag_day(t->text, "escalated");
+            if (base < 0) base = day_number(t->date);
+            int steps = (today - base) / esc_age_days;
+            if (steps > 0) {
+                char day[11];
+                format_day(base + steps * esc_age_days, day);
+                if (set_text_tag(t->text, "escalated", day))
+                    prio = steps >= prio - 'A' ? 'A' : prio - steps;
+            }
+        }
+        int due = esc_due_days >= 0 ? tag_day(t->text, "due") : -1;
+        if (due >= 0 && due - today <= esc_due_days) prio = 'A';
+
+        if (prio != was) {
+            snprintf(t->priority, sizeof t->priority, "(%c)", prio);
+            changed[n++] = t;
+        }
+        todo_changed(t);
+    }
+
+    if (n == 0) return;
+    save_todos_to_file();
+    run_hooks(EV_ESCALATE, changed, n);
+}
+
+/* re-read the file, staying in the same context and on the same item */
+static void reload_todos(void)
+{
+    char ctx[MAX_TYPE];
+    snprintf(ctx, sizeof ctx, "%s", types[selected_type]);
+
+    Todo keep, *t = view_at(selected_index);
+    if (t) keep = *t;
+    load_follow = t ? &keep : NULL;
+    load_follow_id = -1;
+    load_todos(todo_filename);
+    load_follow = NULL;
+    sync_loaded();
+    escalate_due_items();
+
+    selected_type = 0;
+    for (int i = 0; i < type_count; ++i)
+        if (strcmp(types[i], ctx) == 0) selected_type = i;
+    restore_selection(load_follow_id);
+}
+static void toggle_completed(int visible_index)
+{
+    Todo *t = view_at(visible_index);
+    if (!t) return;
+
+    t->completed = !t->completed;
+
+    if (t->completed) {
+        // Set today's date
+        time_t now = time(NULL);
+        struct tm *tm_now = localtime(&now);
+        strftime(t->completion_date, sizeof t->completion_date, "%Y-%m-%d", tm_now);
+
+        // If priority exists, move it to end of text as "pri:X"
+        if (t->priority[0] == '(' && t->priority[2] == ')') {
+            char pri_tag[8];
+            snprintf(pri_tag, sizeof pri_tag, " pri:%c", t->priority[1]);
+
+            // Only append if not already there
+            if (!strstr(t->text, pri_tag) &&
+                strlen(t->text) + strlen(pri_tag) < MAX_LINE) {
+                strcat(t->text, pri_tag);
+            }
+
+            // Clear priority field
+            t->priority[0] = '\0';
+        }
+        // 🔽 ADD THIS LINE to trigger exec hook
+        run_hook(EV_COMPLETE, t);
+    } else {
+        t->completion_date[0] = '\0';
+
+        // On un-complete: detect and extract "pri:X" from end of text
+        char *pri = strstr(t->text, " pri:");
+        if (pri && strlen(pri) == 6 && isalpha((unsigned char)pri[5])) {
+            // Restore priority
+            snprintf(t->priority, sizeof t->priority, "(%c)", pri[5]);
+
+            // Remove it from the end of text
+            *pri = '\0';
+
+            // Also trim trailing whitespace just in case
+            size_t len = strlen(t->text);
+            while (len > 0 && isspace((unsigned char)t->text[len - 1])) {
+                t->text[len - 1] = '\0';
+                len--;
+            }
+        }
+        // 🔽 ADD THIS LINE to trigger exec hook
+        run_hook(EV_UNCOMPLETE, t);
+    }
+
+    todo_changed(t);
+    save_todos_to_file();
+}
+
+
+/* ───────────────────────────────────────────────────────────── sync ── */
+
+/*
+ * --sync DIR replicates the list through a folder shared between devices
+ * (Syncthing and the like). Each device only ever appends to its own
+ * DIR/<device>.log, one op per line:
+ *
+ *     <clock> <device> <key> <field> <value>
+ *
+ * Items are keyed by their id: tag. Every field is a last-writer-wins
+ * register stamped with a hybrid clock (wall-clock ms, or one past the
+ * largest clock seen if that is ahead), ties going to the larger device
+ * name; `del` is final and `new` carries the whole line. Applying ops in
+ * any order gives the same state, so every device that has read the same
+ * logs writes the same todo.txt, ordered by a fractional `pos` per item.
+ *
+ * Local edits are found after each save by diffing the list against the
+ * merged state; other logs are read every few seconds and the file is
+ * rewritten from the state when they change anything. DIR/<device>.seen
+ * records how much of each log todo.txt reflects, so that edits made while
+ * nntm was not running are told apart from ops not merged yet.
+ */
+#define SYNC_DEVS 64
+
+enum { SF_DATE, SF_DONE, SF_PRI, SF_TYPE, SF_TEXT, SF_POS, SF_COUNT };
+static const char *sync_fields[SF_COUNT] = { "date", "done", "pri", "type", "text", "pos" };
+
+typedef struct {
+    unsigned long long clock;
+    int dev;                            /* -1: never set */
+} SyncStamp;
+
+typedef struct {
+    char      key[ITEM_KEY];
+    bool      born, del;                /* seen its `new` / its `del` */
+    Todo      t;
+    double    pos;
+    SyncStamp stamp[SF_COUNT];
+} SyncItem;
+
+static struct {
+    char name[SYNC_NAME];
+    long off;                           /* merged up to here */
+    long stop;                          /* from .seen, -1 if not listed */
+} sync_devs[SYNC_DEVS];
+static int sync_dev_count = 0;
+
+static SyncItem *sync_items = NULL;    /* every key ever seen, deleted ones too */
+static int  sync_count = 0, sync_cap = 0;
+static int *sync_map = NULL;            /* key -> item, -1 empty; twice sync_cap */
+static unsigned long long sync_clock = 0;
+
+static int  sync_own = -1, sync_fd = -1;
+static bool sync_replay = false;        /* startup: read only up to .seen */
+static bool sync_bootstrap = false;     /* first run: the file may be stale */
+static bool sync_dirty = false;         /* file holds an item deleted elsewhere */
+
+static const char sync_name_chars[] =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-";
+
+static bool sync_name_ok(const char *name)
+{
+    size_t n = strspn(name, sync_name_chars);
+    return n > 0 && n < SYNC_NAME && name[n] == '\0';
+}
+
+static int sync_dev_index(const char *name)
+{
+    for (int i = 0; i < sync_dev_count; ++i)
+        if (strcmp(sync_devs[i].name, name) == 0) return i;
+    if (sync_dev_count >= SYNC_DEVS) return -1;
+    snprintf(sync_devs[sync_dev_count].name, SYNC_NAME, "%s", name);
+    sync_devs[sync_dev_count].off = 0;
+    sync_devs[sync_dev_count].stop = -1;
+    return sync_dev_count++;
+}
+
+static int sync_slot(const char *key)
+{
+    unsigned h = 2166136261u, mask = (unsigned)sync_cap * 2 - 1;
+    for (const char *p = key; *p; ++p) h = (h ^ (unsigned char)*p) * 16777619u;
+    int i = h & mask;
+    while (sync_map[i] >= 0 && strcmp(sync_items[sync_map[i]].key, key) != 0) i = (i + 1) & mask;
+    return i;
+}
+
+/* double the item table and rehash; false (and the op is lost) only without memory */
+static bool sync_grow(void)
+{
+    int cap = sync_cap ? sync_cap * 2 : 4096;
+    SyncItem *items = realloc(sync_items, cap * sizeof *items);
+    if (items) sync_items = items;
+    int *map = items ? malloc(cap * 2 * sizeof *map) : NULL;
+    if (!map) {
+        fprintf(stderr, "sync: out of memory at %d items, ops are dropped\n", sync_count);
+        return false;
+    }
+    free(sync_map);
+    sync_map = map;
+    sync_cap = cap;
+    memset(sync_map, 0xff, cap * 2 * sizeof *map);
+    for (int s = 0; s < sync_count; ++s) sync_map[sync_slot(sync_items[s].key)] = s;
+    return true;
+}
+
+static int sync_find(const char *key, bool create)
+{
+    int i = sync_cap ? sync_slot(key) : -1;
+    if (i >= 0 && sync_map[i] >= 0) return sync_map[i];
+    if (!create) return -1;
+    if (sync_count == sync_cap) {
+        if (!sync_grow()) return -1;
+        i = sync_slot(key);
+    }
+
+    SyncItem *s = &sync_items[sync_count];
+    memset(s, 0, sizeof *s);
+    snprintf(s->key, ITEM_KEY, "%s", key);
+    for (int f = 0; f < SF_COUNT; ++f) s->stamp[f].dev = -1;
+    sync_map[i] = sync_count;
+    return sync_count++;
+}
+
+/* a field of t as it goes over the wire */
+static void sync_value(const Todo *t, int f, char *out, size_t size)
+{
+    switch (f) {
+    case SF_DATE: snprintf(out, size, "%s", t->date); break;
+    case SF_DONE: snprintf(out, size, "%s", !t->completed ? "" : t->completion_date[0] ? t->completion_date : "x"); break;
+    case SF_PRI:  snprintf(out, size, "%s", t->priority); break;
+    case SF_TYPE: snprintf(out, size, "%s", t->type); break;
+    default:      snprintf(out, size, "%s", t->text); break;
+    }
+}
+
+static void sync_set(Todo *t, int f, const char *v)
+{
+    switch (f) {
+    case SF_DATE: snprintf(t->date, sizeof t->date, "%s", v); break;
+    case SF_DONE:
+        t->completed = v[0] != '\0';
+        snprintf(t->completion_date, sizeof t->completion_date, "%s", strcmp(v, "x") ? v : "");
+        break;
+    case SF_PRI:  snprintf(t->priority, sizeof t->priority, "%s", v); break;
+    case SF_TYPE: snprintf(t->type, sizeof t->type, "%s", v); break;
+    default:      snprintf(t->text, sizeof t->text, "%s", v); break;
+    }
+}
+
+static bool sync_newer(SyncStamp a, SyncStamp b)
+{
+    if (b.dev < 0) return true;
+    if (a.clock != b.clock) return a.clock > b.clock;
+    return strcmp(sync_devs[a.dev].name, sync_devs[b.dev].name) > 0;
+}
+
+static bool sync_assign(SyncItem *s, int f, SyncStamp st, const char *v)
+{
+    if (!sync_newer(st, s->stamp[f])) return false;
+    s->stamp[f] = st;
+    if (f == SF_POS) s->pos = strtod(v, NULL);
+    else sync_set(&s->t, f, v);
+    return true;
+}
+
+/* apply one log line of device dev; true if the state changed */
+static bool sync_apply(int dev, char *line)
+{
+    char *tok[4], *p = line;
+    for (int i = 0; i < 4; ++i) {
+        tok[i] = p;
+        if (!(p = strchr(p, ' '))) return false;
+        *p++ = '\0';
+    }
+    SyncStamp st = { strtoull(tok[0], NULL, 10), dev };
+    if (st.clock > sync_clock) sync_clock = st.clock;
+    if (strlen(tok[2]) >= ITEM_KEY) return false;
+
+    int i = sync_find(tok[2], true);
+    if (i < 0) return false;
+    SyncItem *s = &sync_items[i];
+    const char *field = tok[3], *value = p;
+
+    if (strcmp(field, "del") == 0) {
+        if (s->del) return false;
+        s->del = true;
+        return true;
+    }
+    if (strcmp(field, "new") == 0) {
+        Todo t;
+        char v[MAX_LINE];
+        bool changed = !s->born;
+        s->born = true;
+        parse_todo_line(value, &t);
+        for (int f = 0; f < SF_POS; ++f) {
+            sync_value(&t, f, v, sizeof v);
+            changed |= sync_assign(s, f, st, v);
+        }
+        return changed;
+    }
+    for (int f = 0; f < SF_COUNT; ++f)
+        if (strcmp(field, sync_fields[f]) == 0) return sync_assign(s, f, st, value);
+    return false;
+}
+
+/* merge the unread complete lines of a device's log */
+static bool sync_read_log(int d)
+{
+    if (sync_replay && d != sync_own && sync_devs[d].stop < 0) return false;
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/%s.log", sync_dir, sync_devs[d].name);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    long end = fstat(fd, &st) == 0 ? (long)st.st_size : 0;
+    if (sync_replay && d != sync_own && end > sync_devs[d].stop) end = sync_devs[d].stop;
+    if (end <= sync_devs[d].off) { close(fd); return false; }
+
+    size_t size = (size_t)(end - sync_devs[d].off);
+    char *buf = malloc(size);
+    ssize_t got = buf ? pread(fd, buf, size, sync_devs[d].off) : -1;
+    close(fd);
+
+    bool changed = false;
+    char *p = buf, *lim = buf + (got > 0 ? got : 0);
+    for (char *nl; p < lim && (nl = memchr(p, '\n', (size_t)(lim - p))); p = nl + 1) {
+        *nl = '\0';
+        changed |= sync_apply(d, p);
+    }
+    sync_devs[d].off += p - buf;
+    free(buf);
+    return changed;
+}
+
+/* pick up logs of devices that appeared, then merge every log's tail */
+static bool sync_read_all(void)
+{
+    DIR *dir = opendir(sync_dir);
+    if (dir) {
+        for (struct dirent *e; (e = readdir(dir)); ) {
+            char name[SYNC_NAME];
+            size_t n = strlen(e->d_name);
+            if (n <= 4 || n - 4 >= SYNC_NAME || strcmp(e->d_name + n - 4, ".log") != 0) continue;
+            memcpy(name, e->d_name, n - 4);
+            name[n - 4] = '\0';
+            if (sync_name_ok(name)) sync_dev_index(name);
+        }
+        closedir(dir);
+    }
+    bool changed = false;
+    for (int d = 0; d < sync_dev_count; ++d) changed |= sync_read_log(d);
+    return changed;
+}
+
+static bool sync_load_seen(void)
+{
+    char path[PATH_MAX], name[SYNC_NAME];
+    long off;
+    snprintf(path, sizeof path, "%s/%s.seen", sync_dir, sync_device);
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    while (fscanf(f, "%63s %ld", name, &off) == 2) {
+        int d = sync_name_ok(name) ? sync_dev_index(name) : -1;
+        if (d >= 0) sync_devs[d].stop = off;
+    }
+    fclose(f);
+    return true;
+}
+
+static void sync_save_seen(void)
+{
+    char path[PATH_MAX], tmp[PATH_MAX];
+    snprintf(path, sizeof path, "%s/%s.seen", sync_dir, sync_device);
+    snprintf(tmp, sizeof tmp, "%s/%s.seen.tmp", sync_dir, sync_device);
+    FILE *f = fopen(tmp, "w");
+    if (!f) return;
+    for (int d = 0; d < sync_dev_count; ++d)
+        if (d != sync_own) fprintf(f, "%s %ld\n", sync_devs[d].name, sync_devs[d].off);
+    if (fclose(f) != 0 || rename(tmp, path) != 0) unlink(tmp);
+}
+
+/* a clock past everything seen and, normally, near the wall clock */
+static unsigned long long sync_tick(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    unsigned long long wall = (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    sync_clock = wall > sync_clock ? wall : sync_clock + 1;
+    return sync_clock;
+}
+
+/*
+ * Give items without an id: tag one, hashed from the line so two devices
+ * starting from the same file pick the same keys. Past the first run a
+ * key that ever existed is not reused, or the item would inherit its
+ * fate. True if any item changed; the caller saves.
+ */
+static bool sync_adopt(void)
+{
+    static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    if (!sync_dir) return false;
+
+    bool any = false;
+    for (int i = 0; i < todo_count; ++i) {
+        Todo *t = &todos[i];
+        char key[ITEM_KEY], line[MAX_LINE * 2];
+        if (item_key_of(t, key)) continue;
+
+        format_todo_line(line, sizeof line, t);
+        unsigned h = 2166136261u;
+        for (const char *p = line; *p; ++p) h = (h ^ (unsigned char)*p) * 16777619u;
+        for (unsigned salt = 0;; ++salt) {
+            unsigned long long v = h ^ (unsigned long long)salt * 2654435761u;
+            key[0] = 'h';
+            for (int k = 1; k < 8; ++k, v /= 36) key[k] = digits[v % 36];
+            key[8] = '\0';
+            if (tree_lookup(key) < 0 && (sync_bootstrap || sync_find(key, false) < 0)) break;
+        }
+        if (!set_text_tag(t->text, "id", key)) continue;     // no room: stays out of sync
+        todo_changed(t);
+        any = true;
+    }
+    return any;
+}
+
+static bool sync_before(int a, int b)
+{
+    if (sync_items[a].pos != sync_items[b].pos) return sync_items[a].pos < sync_items[b].pos;
+    return strcmp(sync_items[a].key, sync_items[b].key) < 0;
+}
+
+static int sync_cmp(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return sync_before(x, y) ? -1 : sync_before(y, x);
+}
+
+static Todo *sync_list[MAX_TODOS];
+static int   sync_list_n;
+
+static void sync_collect(Todo *t, void *arg)
+{
+    (void)arg;
+    sync_list[sync_list_n++] = t;
+}
+
+static void sync_emit(char **buf, size_t *len, size_t *cap, unsigned long long clock,
+                      const char *key, const char *field, const char *value)
+{
+    size_t need = strlen(key) + strlen(field) + strlen(value) + SYNC_NAME + 32;
+    if (*len + need > *cap) {
+        *cap = (*len + need) * 2;
+        *buf = realloc(*buf, *cap);
+    }
+    *len += snprintf(*buf + *len, *cap - *len, "%llu %s %s %s %s\n",
+                     clock, sync_device, key, field, value);
+}
+
+/*
+ * After a save: append an op for everything in the list that differs from
+ * the merged state. Only items off the longest run already in state order
+ * get a new pos, between their neighbours, so a move is one op.
+ */
+static void sync_flush(void)
+{
+    static int  slot[MAX_TODOS], tail[MAX_TODOS], prev[MAX_TODOS];
+    static bool keep[MAX_TODOS], after_ok[MAX_TODOS];
+    static double after[MAX_TODOS];
+    if (!sync_dir || sync_fd < 0) return;     // saves before sync_start are picked up by it
+
+    sync_list_n = 0;
+    for_each_todo(sync_collect, NULL);
+    int n = sync_list_n, len = 0;
+    bool *seen = calloc(sync_cap ? sync_cap : 1, sizeof *seen);
+    if (!seen) { perror("sync"); return; }
+
+    for (int i = 0; i < n; ++i) {
+        char key[ITEM_KEY];
+        slot[i] = item_key_of(sync_list[i], key) ? sync_find(key, false) : -2;
+        if (slot[i] >= 0 && seen[slot[i]]) slot[i] = -2;     // a pasted duplicate
+        if (slot[i] >= 0) seen[slot[i]] = true;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        keep[i] = false;
+        int s = slot[i];
+        if (s < 0 || !sync_items[s].born || sync_items[s].del) continue;
+        int lo = 0, hi = len;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (sync_before(slot[tail[mid]], s)) lo = mid + 1; else hi = mid;
+        }
+        prev[i] = lo > 0 ? tail[lo - 1] : -1;
+        tail[lo] = i;
+        if (lo == len) len++;
+    }
+    for (int i = len ? tail[len - 1] : -1; i >= 0; i = prev[i]) keep[i] = true;
+
+    // the pos of the next item that keeps its place
+    for (int i = n - 1, next = -1; i >= 0; --i) {
+        after_ok[i] = next >= 0;
+        after[i] = next >= 0 ? sync_items[slot[next]].pos : 0;
+        if (keep[i]) next = i;
+    }
+
+    unsigned long long clock = sync_tick();
+    char *buf = NULL, v[MAX_LINE * 2], w[MAX_LINE];
+    size_t used = 0, cap = 0;
+    double last = 0;
+    bool has_last = false;
+
+    for (int i = 0; i < n; ++i) {
+        if (slot[i] == -2) continue;
+        SyncItem *s = slot[i] >= 0 ? &sync_items[slot[i]] : NULL;
+        char key[ITEM_KEY];
+        item_key_of(sync_list[i], key);
+
+        double pos = keep[i] ? s->pos
+                   : has_last && after_ok[i] ? (last + after[i]) / 2
+                   : has_last ? last + 1
+                   : after_ok[i] ? after[i] - 1 : 1;
+        last = pos;
+        has_last = true;
+
+        if (s && s->born && s->del) { sync_dirty = true; continue; }   // deleted elsewhere
+        if (!s || !s->born) {
+            int k = format_todo_line(v, sizeof v, sync_list[i]);
+            v[k > 0 ? k - 1 : 0] = '\0';
+            sync_emit(&buf, &used, &cap, clock, key, "new", v);
+        } else if (sync_bootstrap) {
+            continue;                   // the logs are newer than this file
+        } else {
+            for (int f = 0; f < SF_POS; ++f) {
+                sync_value(sync_list[i], f, v, sizeof v);
+                sync_value(&s->t, f, w, sizeof w);
+                if (strcmp(v, w) != 0) sync_emit(&buf, &used, &cap, clock, key, sync_fields[f], v);
+            }
+        }
+        if (!keep[i] && (!s || pos != s->pos)) {
+            snprintf(v, sizeof v, "%.17g", pos);
+            sync_emit(&buf, &used, &cap, clock, key, "pos", v);
+        }
+    }
+
+    // gone from a full list: deleted or archived here
+    if (!sync_bootstrap && todo_count < MAX_TODOS)
+        for (int s = 0; s < sync_count; ++s)
+            if (sync_items[s].born && !sync_items[s].del && !seen[s])
+                sync_emit(&buf, &used, &cap, clock, sync_items[s].key, "del", "");
+
+    if (used > 0 && write(sync_fd, buf, used) != (ssize_t)used) perror("sync log");
+    free(buf);
+    free(seen);
+    sync_read_log(sync_own);
+}
+
+/* rewrite todo.txt from the merged state; the caller reloads */
+static void sync_regenerate(void)
+{
+    int n = 0, *live = malloc((sync_count ? sync_count : 1) * sizeof *live);
+    if (!live) { perror("sync"); return; }
+    for (int s = 0; s < sync_count; ++s)
+        if (sync_items[s].born && !sync_items[s].del) live[n++] = s;
+    qsort(live, n, sizeof live[0], sync_cmp);
+
+    // sealed files are written through a temp file anyway
+    Replace r;
+    FILE *f = crypt_on ? store_create(todo_filename, false)
+            : replace_open(&r, todo_filename, ".sync.tmp") ? r.f : NULL;
+    if (!f) { perror(todo_filename); free(live); return; }
+    for (int i = 0; i < n; ++i) write_todo_line(f, &sync_items[live[i]].t);
+    free(live);
+    if (crypt_on ? !store_commit(f, todo_filename) : !replace_commit(&r)) {
+        perror("sync write");
+        return;
+    }
+    sync_save_seen();
+    sync_dirty = false;
+}
+
+/* after a (re)load: key new items and record edits made outside nntm */
+static void sync_loaded(void)
+{
+    if (!sync_dir) return;
+    if (sync_adopt()) save_todos_to_file();
+    else sync_flush();
+}
+
+static void sync_start(void)
+{
+    if (!sync_dir) return;
+    if (!sync_device[0]) {
+        gethostname(sync_device, sizeof sync_device - 1);
+        for (char *p = sync_device; *p; ++p)
+            if (!strchr(sync_name_chars, *p)) *p = '-';
+    }
+    if (!sync_name_ok(sync_device)) {
+        fprintf(stderr, "--device: use letters, digits, '-' and '_'\n");
+        exit(1);
+    }
+    if (mkdir(sync_dir, 0755) != 0 && errno != EEXIST) { perror(sync_dir); exit(1); }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/%s.log", sync_dir, sync_device);
+    sync_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (sync_fd < 0) { perror(path); exit(1); }
+    sync_own = sync_dev_index(sync_device);
+
+    // replay to where todo.txt was last written, record what changed since,
+    // then merge the rest
+    sync_replay = sync_load_seen();
+    sync_bootstrap = !sync_replay;
+    sync_read_all();
+    sync_loaded();
+    sync_replay = sync_bootstrap = false;
+    sync_read_all();
+    sync_regenerate();
+    load_todos(todo_filename);
+}
+
+/* merge what other devices appended; rewrite and reload if it changed */
+static void sync_poll(void)
+{
+    if (!sync_dir) return;
+    if (!sync_read_all() && !sync_dirty) return;
+    sync_regenerate();
+    reload_todos();
+}
+
+/* ────────────────────────────────────────────────────────── maildir ── */
+
+/*
+ * --maildir DIR turns flagged mail into todos: messages in DIR/cur whose
+ * ":2," info carries the F flag (--mail-all: every message delivered to
+ * DIR/new). Subject and sender become the text, --mail-context (default
+ * "mail") the context. Flagging a message renames it within cur/, so
+ * inotify reports it while the viewer runs, and the directory is scanned
+ * once at startup. Whatever has queued up is read in parallel and
+ * added in one go with one save and one hook call. A message is recognised
+ * again by the hash of its Message-ID; the hashes of messages already taken
+ * are kept in todo.mail.seen, so the mail itself is never touched.
+ */
+#define MAIL_HEAD (64 * 1024)           /* bytes of a message read for headers */
+
+typedef struct {
+    char     *name;
+    uint64_t  hash;                     /* of the Message-ID, 0 if unreadable */
+    char      text[MAX_LINE];
+} MailJob;
+
+static const char *mail_dir = NULL;
+static const char *mail_context = "mail";
+static bool        mail_all = false;    /* --mail-all: DIR/new, flagged or not */
+static int         mail_fd = -1;        /* inotify on DIR/cur or DIR/new */
+static bool        mail_rescan = false; /* events lost or list was full: scan again */
+
+static uint64_t   *mail_seen = NULL;    /* open addressing, 0 = empty */
+static size_t      mail_seen_cap = 0, mail_seen_count = 0;
+static char        mail_seen_path[PATH_MAX];
+
+static MailJob    *mail_jobs = NULL;
+static int         mail_njobs = 0, mail_jobs_cap = 0;
+static int         mail_next;           /* next job to parse, taken atomically */
+
+static bool mail_seen_has(uint64_t h)
+{
+    if (!mail_seen_cap) return false;
+    for (size_t i = h & (mail_seen_cap - 1); mail_seen[i]; i = (i + 1) & (mail_seen_cap - 1))
+        if (mail_seen[i] == h) return true;
+    return false;
+}
+
+static void mail_seen_add(uint64_t h)
+{
+    if (mail_seen_has(h)) return;
+    if ((mail_seen_count + 1) * 2 > mail_seen_cap) {
+        uint64_t *old = mail_seen;
+        size_t old_cap = mail_seen_cap;
+        mail_seen_cap = old_cap ? old_cap * 2 : 1024;
+        mail_seen = calloc(mail_seen_cap, sizeof *mail_seen);
+        mail_seen_count = 0;
+        for (size_t i = 0; i < old_cap; ++i)
+            if (old[i]) mail_seen_add(old[i]);
+        free(old);
+    }
+    size_t i = h & (mail_seen_cap - 1);
+    while (mail_seen[i]) i = (i + 1) & (mail_seen_cap - 1);
+    mail_seen[i] = h;
+    mail_seen_count++;
+}
+
+static int unhex(int c)
+{
+    return isdigit(c) ? c - '0' : isxdigit(c) ? tolower(c) - 'a' + 10 : -1;
+}
+
+/* decode RFC 2047 words (=?charset?B|Q?...?=) in place; bytes pass through as they are */
+static void mail_decode(char *s)
+{
+    static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char *out = s, *after_word = NULL;
+    for (char *p = s; *p; ) {
+        char *q1 = p[0] == '=' && p[1] == '?' ? strchr(p + 2, '?') : NULL;
+        char enc = q1 ? (char)toupper((unsigned char)q1[1]) : 0;
+        char *end = q1 && (enc == 'B' || enc == 'Q') && q1[2] == '?' ? strstr(q1 + 3, "?=") : NULL;
+        if (!end) { *out++ = *p++; continue; }
+
+        // whitespace between two encoded words goes
+        if (after_word) out = after_word;
+        unsigned bits = 0;
+        int nbits = 0;
+        for (char *c = q1 + 3; c < end; ++c) {
+            if (enc == 'Q') {
+                int hi, lo;
+                if (*c == '_') *out++ = ' ';
+                else if (*c == '=' && c + 2 < end && (hi = unhex((unsigned char)c[1])) >= 0 &&
+                         (lo = unhex((unsigned char)c[2])) >= 0) { *out++ = (char)(hi << 4 | lo); c += 2; }
+                else *out++ = *c;
+            } else {
+                const char *v = *c ? strchr(b64, *c) : NULL;
+                if (!v) continue;
+                bits = bits << 6 | (unsigned)(v - b64);
+                if ((nbits += 6) >= 8) { nbits -= 8; *out++ = (char)(bits >> nbits); }
+            }
+        }
+        p = end + 2;
+        after_word = out;
+        while (*p == ' ' || *p == '\t') *out++ = *p++;
+        if (!*p || !(p[0] == '=' && p[1] == '?')) after_word = NULL;
+    }
+    *out = '\0';
+}
+
+/* value of header name in an unfolded header block, copied to out */
+static bool mail_header(const char *head, const char *name, char *out, size_t size)
+{
+    size_t len = strlen(name);
+    for (const char *l = head; *l; ) {
+        const char *nl = strchr(l, '\n');
+        if (strncasecmp(l, name, len) == 0 && l[len] == ':') {
+            const char *v = l + len + 1;
+            while (*v == ' ' || *v == '\t') ++v;
+            size_t n = nl ? (size_t)(nl - v) : strlen(v);
+            if (n >= size) n = size - 1;
+            memcpy(out, v, n);
+            out[n] = '\0';
+            return true;
+        }
+        if (!nl) break;
+        l = nl + 1;
+    }
+    return false;
+}
+
+/* read the header of one message and build its todo text */
+static void mail_parse(MailJob *job)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/%s/%s", mail_dir, mail_all ? "new" : "cur", job->name);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return;
+    static __thread char head[MAIL_HEAD + 1];
+    ssize_t got = read(fd, head, MAIL_HEAD);
+    close(fd);
+    if (got <= 0) return;
+    head[got] = '\0';
+
+    // cut at the empty line, unfold continuation lines, drop CRs
+    char *w = head;
+    for (char *r = head; *r; ++r) {
+        if (*r == '\r') continue;
+        if (*r == '\n' && (r[1] == '\n' || (r[1] == '\r' && r[2] == '\n'))) break;
+        if (*r == '\n' && (r[1] == ' ' || r[1] == '\t')) { *w++ = ' '; continue; }
+        *w++ = *r;
+    }
+    *w = '\0';
+
+    char id[MAX_LINE], subject[MAX_LINE], from[MAX_LINE], addr[MAX_LINE];
+    if (!mail_header(head, "Message-ID", id, sizeof id)) {
+        // no Message-ID: the unique part of the maildir file name stands in
+        snprintf(id, sizeof id, "%.*s", (int)strcspn(job->name, ":"), job->name);
+    }
+    if (!mail_header(head, "Subject", subject, sizeof subject)) subject[0] = '\0';
+    if (!mail_header(head, "From", from, sizeof from)) from[0] = '\0';
+    mail_decode(subject);
+
+    // "Name <addr>" or a bare address
+    char *lt = strchr(from, '<'), *gt = lt ? strchr(lt, '>') : NULL;
+    if (lt && gt) snprintf(addr, sizeof addr, "%.*s", (int)(gt - lt - 1), lt + 1);
+    else snprintf(addr, sizeof addr, "%.*s", (int)strcspn(from, " \t("), from);
+
+    // one line of single spaces, room left for the from: tag
+    char *o = job->text, *limit = job->text + MAX_LINE / 2;
+    for (const char *c = subject; *c && o < limit; ++c) {
+        char ch = (unsigned char)*c < ' ' || *c == 127 ? ' ' : *c;
+        if (ch == ' ' && (o == job->text || o[-1] == ' ')) continue;
+        *o++ = ch;
+    }
+    while (o > job->text && o[-1] == ' ') --o;
+    if (o == job->text) o += sprintf(o, "(no subject)");
+    if (addr[0] && !strpbrk(addr, " \t"))
+        snprintf(o, (size_t)(job->text + MAX_LINE - o), " from:%.*s", MAX_LINE / 4, addr);
+    else
+        *o = '\0';
+    job->hash = hash64(id, strlen(id)) | 1;
+}
+
+static void *mail_worker(void *arg)
+{
+    (void)arg;
+    for (int i; (i = __atomic_fetch_add(&mail_next, 1, __ATOMIC_RELAXED)) < mail_njobs; )
+        mail_parse(&mail_jobs[i]);
+    return NULL;
+}
+
+static void mail_queue(const char *name)
+{
+    if (name[0] == '.') return;
+    const char *info = strstr(name, ":2,");
+    if (!mail_all && (!info || !strchr(info + 3, 'F'))) return;
+    if (mail_njobs == mail_jobs_cap) {
+        int cap = mail_jobs_cap ? mail_jobs_cap * 2 : 64;
+        MailJob *grown = realloc(mail_jobs, (size_t)cap * sizeof *grown);
+        if (!grown) return;
+        mail_jobs = grown;
+        mail_jobs_cap = cap;
+    }
+    mail_jobs[mail_njobs++] = (MailJob){ .name = strdup(name) };
+}
+
+static void mail_scan(void)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/%s", mail_dir, mail_all ? "new" : "cur");
+    DIR *d = opendir(path);
+    if (!d) return;
+    for (struct dirent *e; (e = readdir(d)); ) mail_queue(e->d_name);
+    closedir(d);
+    mail_rescan = false;
+}
+
+/* parse everything queued, add what is new, one save and one hook call */
+static void mail_ingest(void)
+{
+    if (mail_njobs == 0) return;
+    mail_next = 0;
+    run_pool(mail_worker, mail_njobs);
+
+    static Todo *added[MAX_TODOS];
+    int n = 0;
+    char *seen = NULL;
+    size_t seen_len = 0;
+    FILE *log = open_memstream(&seen, &seen_len);
+    int sel = selected_id();
+    add_type(mail_context);
+
+    for (int i = 0; i < mail_njobs; ++i) {
+        MailJob *job = &mail_jobs[i];
+        if (job->hash && !mail_seen_has(job->hash)) {
+            Todo *t = append_todo(job->text, mail_context);
+            if (!t) { mail_rescan = true; break; }   // list full: the rest waits for a rescan
+            added[n++] = t;
+            mail_seen_add(job->hash);
+            fprintf(log, "%016llx\n", (unsigned long long)job->hash);
+        }
+    }
+    for (int i = 0; i < mail_njobs; ++i) free(mail_jobs[i].name);
+    mail_njobs = 0;
+    fclose(log);
+
+    if (n > 0) {
+        reindex_todos();
+        for (int i = 0; i < n; ++i) {
+            seq_place(added[i], NULL);
+            todo_changed(added[i]);
+        }
+        save_todos_to_file();
+
+        // recorded only once the items are on disk: a crash repeats mail, never loses it
+        FILE *f = fopen(mail_seen_path, "a");
+        if (f) {
+            fwrite(seen, 1, seen_len, f);
+            fclose(f);
+        }
+        run_hooks(EV_ADD, added, n);
+        restore_selection(sel);
+    }
+    free(seen);
+}
+
+static void mail_start(void)
+{
+    if (!mail_dir) return;
+    if (*mail_context == '@') ++mail_context;
+    sidecar_path(mail_seen_path, sizeof mail_seen_path, "todo.mail.seen");
+    FILE *f = fopen(mail_seen_path, "r");
+    if (f) {
+        for (unsigned long long h; fscanf(f, "%llx", &h) == 1; ) mail_seen_add(h);
+        fclose(f);
+    }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/%s", mail_dir, mail_all ? "new" : "cur");
+    mail_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (mail_fd < 0 || inotify_add_watch(mail_fd, path, IN_MOVED_TO | IN_CLOSE_WRITE) < 0) {
+        perror(path);
+        exit(1);
+    }
+    mail_scan();
+    mail_ingest();
+}
+
+/* take the names inotify has reported and ingest them */
+static void mail_poll(void)
+{
+    if (mail_fd < 0) return;
+    char buf[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (ssize_t len; (len = read(mail_fd, buf, sizeof buf)) > 0; ) {
+        for (char *p = buf; p < buf + len; ) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            if (ev->mask & IN_Q_OVERFLOW) mail_rescan = true;
+            else if (ev->len) mail_queue(ev->name);
+            p += sizeof *ev + ev->len;
+        }
+    }
+    if (mail_rescan && todo_count < MAX_TODOS) {
+        for (int i = 0; i < mail_njobs; ++i) free(mail_jobs[i].name);
+        mail_njobs = 0;
+        mail_scan();
+    }
+    mail_ingest();
+}
+
+/* ───────────────────────────────────────────────────────────── soak ── */
+
+/*
+ * `nntm soak <todo-file> [--minutes N] [--seed N] [--exec script]` drives
+ * the viewer's own operations headless (no terminal) with random edits,
+ * hooks, sorts, moves, context jumps, archives and outside appends followed
+ * by reloads, for as long as asked. It samples RSS, open fds, child
+ * processes and operation latency along the way and fails if any of them
+ * ends up clearly above where it started. It edits the file it is given,
+ * so point it at a copy.
+ */
+#define SOAK_SAMPLES 20
+
+typedef struct {
+    long   t;                   /* seconds since start */
+    long   rss_kb;
+    int    fds;
+    int    children;
+    long   ops;
+    double mean_us, max_us;
+} SoakSample;
+
+static long now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+static long soak_rss_kb(void)
+{
+    long pages = 0, rss = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    if (fscanf(f, "%ld %ld", &pages, &rss) != 2) rss = 0;
+    fclose(f);
+    return rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static int soak_fds(void)
+{
+    int n = 0;
+    DIR *d = opendir("/proc/self/fd");
+    if (!d) return 0;
+    for (struct dirent *e; (e = readdir(d)); )
+        if (e->d_name[0] != '.') n++;
+    closedir(d);
+    return n - 1;                                   // the DIR itself
+}
+
+/* live and zombie children, from the ppid field of /proc/<pid>/stat */
+static int soak_children(void)
+{
+    int n = 0;
+    pid_t self = getpid();
+    DIR *d = opendir("/proc");
+    if (!d) return 0;
+    for (struct dirent *e; (e = readdir(d)); ) {
+        if (!isdigit((unsigned char)e->d_name[0])) continue;
+        char path[300], buf[512];
+        snprintf(path, sizeof path, "/proc/%s/stat", e->d_name);
+        FILE *f = fopen(path, "r");
+        if (!f) continue;
+        size_t len = fread(buf, 1, sizeof buf - 1, f);
+        fclose(f);
+        buf[len] = '\0';
+        const char *rp = strrchr(buf, ')');        // the name may hold spaces
+        int ppid;
+        char state;
+        if (rp && sscanf(rp + 1, " %c %d", &state, &ppid) == 2 && ppid == self) n++;
+    }
+    closedir(d);
+    return n;
+}
+
+static void soak_op(int op, unsigned *seed)
+{
+    static const char *ctx_names[] = { "work", "home", "errands", "later", "x1", "x2", "x3" };
+    char text[MAX_LINE];
+    int n = view_count();
+    if (n > 0) selected_index = rand_r(seed) % n;
+
+    switch (op) {
+    case 0: case 1: case 2:
+        // a bounded vocabulary, so completion data stops growing
+        snprintf(text, sizeof text, "soak item %u est:%uh due:2026-%02u-%02u",
+                 rand_r(seed) % 500, rand_r(seed) % 9 + 1, rand_r(seed) % 12 + 1, rand_r(seed) % 28 + 1);
+        if (todo_count < MAX_TODOS * 8 / 10) insert_todo(text);
+        break;
+    case 3: case 4:
+        toggle_completed(selected_index);
+        break;
+    case 5: {
+        Todo *t = view_at(selected_index);
+        if (!t || t->completed) break;
+        snprintf(t->priority, sizeof t->priority, "(%c)", 'A' + rand_r(seed) % 4);
+        todo_changed(t);
+        save_todos_to_file();
+        break;
+    }
+    case 6:  sort_todos_by_priority(rand_r(seed) % 2);  break;
+    case 7:  sort_todos_by_date(rand_r(seed) % 2);      break;
+    case 8:  group_todos_by_completed();                break;
+    case 9:  move_selected(rand_r(seed) % 2 ? 1 : -1);  break;
+    case 10: move_selected_to_top();                    break;
+    case 11: {
+        Todo *t = view_at(selected_index);
+        if (t) retype_todo(t, ctx_names[rand_r(seed) % 4]);
+        break;
+    }
+    case 12:
+        // like `@` with a name that may not exist yet
+        switch_context(add_type(ctx_names[rand_r(seed) % 7]));
+        break;
+    case 13: {
+        switch_context(0);
+        archive_completed_todos();
+        // the archive is read on every reload; keep it at a size a real
+        // one reaches, or reload time grows with the run and hides drift
+        struct stat st;
+        if (stat(archive_path, &st) == 0 && st.st_size > 256 * 1024) unlink(archive_path);
+        break;
+    }
+    case 14: {
+        // another program appends, the user reloads
+        FILE *f = fopen(todo_filename, "a");
+        if (f) {
+            fprintf(f, "2026-01-01 @home appended %u\n", rand_r(seed) % 500);
+            fclose(f);
+        }
+        if (todo_count < MAX_TODOS * 8 / 10) reload_todos();
+        break;
+    }
+    case 15:
+        set_filter(rand_r(seed) % 2 ? "soak.*[0-9]+" : "");
+        view_count();
+        break;
+    default:
+        next_check_day();
+        escalate_due_items();
+        reap_children();                            // what the main loop does
+    }
+}
+
+/* keep the store below MAX_TODOS: complete and archive everything */
+static void soak_trim(void)
+{
+    if (todo_count < MAX_TODOS * 8 / 10) return;
+    switch_context(0);
+    set_filter("");
+    for (int i = 0; i < todo_count; ++i) {
+        if (todos[i].completed) continue;
+        todos[i].completed = true;
+        snprintf(todos[i].completion_date, sizeof todos[i].completion_date, "%s", todos[i].date);
+        todo_changed(&todos[i]);
+    }
+    archive_completed_todos();
+}
+
+/* mean of a quarter of the samples, column picked by the accessor */
+static double soak_quarter(const SoakSample *s, int n, bool last, double (*get)(const SoakSample *))
+{
+    int q = n / 4 > 0 ? n / 4 : 1, from = last ? n - q : 1;
+    double sum = 0;
+    for (int i = from; i < from + q && i < n; ++i) sum += get(&s[i]);
+    return sum / q;
+}
+
+static double soak_get_rss(const SoakSample *s)      { return s->rss_kb; }
+static double soak_get_fds(const SoakSample *s)      { return s->fds; }
+static double soak_get_children(const SoakSample *s) { return s->children; }
+static double soak_get_latency(const SoakSample *s)  { return s->mean_us; }
+
+/* copy of src as dir/todo.txt in a fresh scratch dir; the run archives and appends there */
+static bool soak_scratch(const char *src, char *dir, char *path, size_t size)
+{
+    if (!mkdtemp(dir)) { perror(dir); return false; }
+    snprintf(path, size, "%s/todo.txt", dir);
+    FILE *in = fopen(src, "r"), *out = in ? fopen(path, "w") : NULL;
+    bool ok = in && out;
+    char buf[1 << 16];
+    for (size_t n; ok && (n = fread(buf, 1, sizeof buf, in)) > 0; )
+        ok = fwrite(buf, 1, n, out) == n;
+    if (in) fclose(in);
+    if (out && fclose(out) != 0) ok = false;
+    if (!ok) perror(src);
+    return ok;
+}
+
+static void soak_cleanup(const char *dir)
+{
+    DIR *d = opendir(dir);
+    if (!d) return;
+    char path[PATH_MAX];
+    for (struct dirent *e; (e = readdir(d)); ) {
+        if (e->d_name[0] == '.') continue;
+        snprintf(path, sizeof path, "%s/%s", dir, e->d_name);
+        unlink(path);
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+static int run_soak(int argc, char **argv)
+{
+    double minutes = 1;
+    unsigned seed = (unsigned)time(NULL);
+    for (int i = 3; i < argc; ++i) {
+        if (strcmp(argv[i], "--minutes") == 0 && i + 1 < argc) minutes = atof(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--exec") == 0 && i + 1 < argc) hook_add("all", argv[++i]);
+    }
+    if (argc < 3 || minutes <= 0) {
+        fprintf(stderr, "Usage: %s soak <todo-file> [--minutes N] [--seed N] [--exec script]\n", argv[0]);
+        return 2;
+    }
+    // never the real list: the run deletes its archive and appends junk
+    static char scratch[] = "/tmp/nntm-soak-XXXXXX", path[PATH_MAX];
+    if (!soak_scratch(argv[2], scratch, path, sizeof path)) {
+        soak_cleanup(scratch);
+        return 2;
+    }
+    todo_filename = path;
+    if (!hook_count) hook_add("all", "/bin/true");   // hooks must run to leak children
+
+    load_todos(todo_filename);
+    printf("soak a copy of %s for %g min, seed %u\n", argv[2], minutes, seed);
+    printf("%8s %10s %6s %9s %10s %10s %10s\n",
+           "t(s)", "rss(kB)", "fds", "children", "ops", "mean(us)", "max(us)");
+
+    SoakSample samples[SOAK_SAMPLES + 1];
+    int ns = 0;
+    long start = now_us(), duration = (long)(minutes * 60e6);
+    long interval = duration / SOAK_SAMPLES, next = start;
+    long ops = 0, window_ops = 0;
+    double window_sum = 0, window_max = 0;
+
+    for (;;) {
+        long now = now_us();
+        if (now >= next) {
+            SoakSample *s = &samples[ns++];
+            *s = (SoakSample){ (now - start) / 1000000, soak_rss_kb(), soak_fds(),
+                               soak_children(), ops,
+                               window_ops ? window_sum / window_ops : 0, window_max };
+            printf("%8ld %10ld %6d %9d %10ld %10.1f %10.0f\n",
+                   s->t, s->rss_kb, s->fds, s->children, s->ops, s->mean_us, s->max_us);
+            fflush(stdout);
+            window_ops = 0;
+            window_sum = window_max = 0;
+            next += interval;
+            if (ns > SOAK_SAMPLES) break;
+        }
+
+        soak_trim();
+        int op = rand_r(&seed) % 18;
+        long t0 = now_us();
+        soak_op(op, &seed);
+        double us = (double)(now_us() - t0);
+        window_sum += us;
+        if (us > window_max) window_max = us;
+        window_ops++;
+        ops++;
+    }
+
+    // compare the last quarter of the run with the first (after the warm-up sample)
+    static const struct {
+        const char *name;
+        double (*get)(const SoakSample *);
+        double ratio, slack;
+    } checks[] = {
+        { "rss",      soak_get_rss,      1.20, 1024 },
+        { "fds",      soak_get_fds,      1.00, 0 },
+        { "children", soak_get_children, 1.00, 2 },
+        { "latency",  soak_get_latency,  2.00, 50 },
+    };
+    int failed = 0;
+    for (size_t i = 0; i < sizeof checks / sizeof *checks; ++i) {
+        double first = soak_quarter(samples, ns, false, checks[i].get);
+        double last = soak_quarter(samples, ns, true, checks[i].get);
+        bool drift = last > first * checks[i].ratio + checks[i].slack;
+        printf("%-9s first %10.1f  last %10.1f  %s\n", checks[i].name, first, last,
+               drift ? "DRIFT" : "ok");
+        failed += drift;
+    }
+    reap_children();
+    soak_cleanup(scratch);
+    return failed ? 1 : 0;
+}
+
+/* ───────────────────────────────────────────────────────────── http ── */
+
+/*
+ * Optional read-only JSON endpoint on 127.0.0.1 (--http <port>) for local
+ * dashboards. It is served from the in-memory store on the main loop with
+ * non-blocking sockets; /events is a server-sent event stream that gets
+ * one "change" event per loop iteration in which the store changed.
+ */
+#define MAX_CLIENTS 16
+#define HTTP_INBUF  8192
+#define HTTP_SSE_MAX (64 * 1024)   /* unsent event bytes before a stream is dropped */
+
+typedef struct {
+    int    fd;
+    char   in[HTTP_INBUF];
+    size_t in_len;
+    char  *out;
+    size_t out_len, out_off, out_cap;
+    bool   events;                  /* SSE stream, stays open */
+    bool   closing;                 /* close once out is flushed */
+} HttpClient;
+
+static int           http_port     = 0;
+static const char   *http_origin   = NULL;
+static int           http_listen   = -1;
+static HttpClient    http_clients[MAX_CLIENTS];
+static unsigned long http_sent_revision = 0;
+
+static void http_put(HttpClient *c, const char *data, size_t len)
+{
+    if (c->out_len + len > c->out_cap) {
+        c->out_cap = (c->out_len + len) * 2;
+        c->out = realloc(c->out, c->out_cap);
+    }
+    memcpy(c->out + c->out_len, data, len);
+    c->out_len += len;
+}
+
+static void http_printf(HttpClient *c, const char *fmt, ...)
+{
+    char buf[MAX_LINE * 2];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof buf, fmt, ap);
+    va_end(ap);
+    if (n > 0) http_put(c, buf, (size_t)n < sizeof buf ? (size_t)n : sizeof buf - 1);
+}
+
+static void http_json_str(HttpClient *c, const char *s)
+{
+    http_put(c, "\"", 1);
+    for (; *s; ++s) {
+        unsigned char ch = (unsigned char)*s;
+        if (ch == '"' || ch == '\\') {
+            char esc[2] = { '\\', (char)ch };
+            http_put(c, esc, 2);
+        } else if (ch < 0x20) {
+            http_printf(c, "\\u%04x", ch);
+        } else {
+            http_put(c, s, 1);
+        }
+    }
+    http_put(c, "\"", 1);
+}
+
+static void http_close(HttpClient *c)
+{
+    close(c->fd);
+    free(c->out);
+    memset(c, 0, sizeof *c);
+    c->fd = -1;
+}
+
+static void http_flush(HttpClient *c)
+{
+    while (c->out_off < c->out_len) {
+        ssize_t n = send(c->fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) http_close(c);
+            return;
+        }
+        c->out_off += n;
+    }
+    c->out_off = c->out_len = 0;
+    if (c->closing) http_close(c);
+}
+
+/* value of ?key= in query, url-decoded, "" if absent */
+static void http_param(const char *query, const char *key, char *out, size_t size)
+{
+    size_t klen = strlen(key), n = 0;
+    out[0] = '\0';
+    for (const char *p = query; p && *p; p = strchr(p, '&'), p = p ? p + 1 : NULL) {
+        if (strncmp(p, key, klen) != 0 || p[klen] != '=') continue;
+        for (p += klen + 1; *p && *p != '&' && n + 1 < size; ++p) {
+            if (*p == '%' && isxdigit((unsigned char)p[1]) && isxdigit((unsigned char)p[2])) {
+                char hex[3] = { p[1], p[2], 0 };
+                out[n++] = (char)strtol(hex, NULL, 16);
+                p += 2;
+            } else {
+                out[n++] = *p == '+' ? ' ' : *p;
+            }
+        }
+        out[n] = '\0';
+        return;
+    }
+}
+
+/* ids matching ?context= and ?q= (substring), in list order */
+static int http_select(const char *query, int *ids)
+{
+    char ctx[MAX_TYPE], q[MAX_LINE], open[8];
+    http_param(query, "context", ctx, sizeof ctx);
+    http_param(query, "q", q, sizeof q);
+    http_param(query, "open", open, sizeof open);
+
+    static Todo *all[MAX_TODOS];
+    int total = 0, n = 0;
+    seq_collect(SEQ_ALL, seq_all_root, all, &total);
+    for (int i = 0; i < total; ++i) {
+        const Todo *t = all[i];
+        if (ctx[0] && strcmp(ctx, "all") != 0 && strcmp(ctx, t->type) != 0) continue;
+        if (q[0] && !strstr(t->text, q)) continue;
+        if (open[0] == '1' && t->completed) continue;
+        ids[n++] = t->id;
+    }
+    return n;
+}
+
+static void http_todo_json(HttpClient *c, const Todo *t)
+{
+    http_printf(c, "{\"id\":%d,\"completed\":%s,\"priority\":\"%c\",",
+                t->id, t->completed ? "true" : "false",
+                t->priority[0] == '(' ? t->priority[1] : ' ');
+    http_printf(c, "\"date\":");
+    http_json_str(c, t->date);
+    http_printf(c, ",\"completion_date\":");
+    http_json_str(c, t->completion_date);
+    http_printf(c, ",\"context\":");
+    http_json_str(c, t->type);
+    http_printf(c, ",\"text\":");
+    http_json_str(c, t->text);
+    http_put(c, "}", 1);
+}
+
+static void http_respond(HttpClient *c, int status, const char *type, HttpClient *body)
+{
+    http_printf(c, "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+                   "Cache-Control: no-store\r\n",
+                status, status == 200 ? "OK" : status == 404 ? "Not Found" : "Bad Request",
+                type, body->out_len);
+    if (http_origin) http_printf(c, "Access-Control-Allow-Origin: %s\r\n", http_origin);
+    http_printf(c, "Connection: %s\r\n\r\n", c->closing ? "close" : "keep-alive");
+    http_put(c, body->out, body->out_len);
+}
+
+static void http_route(HttpClient *c, const char *method, char *target)
+{
+    static int ids[MAX_TODOS];
+    HttpClient body = { .fd = -1 };
+    int status = 200;
+
+    char *query = strchr(target, '?');
+    if (query) *query++ = '\0';
+
+    if (strcmp(method, "GET") != 0) {
+        status = 400;
+        http_printf(&body, "{\"error\":\"only GET is supported\"}");
+    } else if (strcmp(target, "/events") == 0) {
+        http_printf(c, "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+                       "Cache-Control: no-store\r\n");
+        if (http_origin) http_printf(c, "Access-Control-Allow-Origin: %s\r\n", http_origin);
+        http_printf(c, "\r\nevent: change\ndata: {\"revision\":%lu}\n\n", store_revision);
+        c->events = true;
+        return;
+    } else if (strcmp(target, "/todos") == 0) {
+        int n = http_select(query, ids);
+        http_put(&body, "[", 1);
+        for (int i = 0; i < n; ++i) {
+            if (i) http_put(&body, ",", 1);
+            http_todo_json(&body, todo_by_id(ids[i]));
+        }
+        http_put(&body, "]", 1);
+    } else if (strcmp(target, "/contexts") == 0) {
+        http_put(&body, "[", 1);
+        for (int i = 0; i < type_count; ++i) {
+            int count = i == 0 ? seq_size(SEQ_ALL, seq_all_root)
+                               : seq_size(SEQ_CTX, seq_ctx_root[i]);
+            http_printf(&body, "%s{\"name\":", i ? "," : "");
+            http_json_str(&body, types[i]);
+            http_printf(&body, ",\"count\":%d}", count);
+        }
+        http_put(&body, "]", 1);
+    } else if (strcmp(target, "/aggregate") == 0) {
+        int n = http_select(query, ids), open = 0;
+        double sums[MAX_TAG_COLS];
+        tags_totals(ids, n, sums);
+        for (int i = 0; i < n; ++i)
+            if (!todo_by_id(ids[i])->completed) open++;
+        http_printf(&body, "{\"count\":%d,\"open\":%d,\"tags\":{", n, open);
+        for (int col = 0; col < tag_col_count; ++col) {
+            if (col) http_put(&body, ",", 1);
+            http_json_str(&body, tag_keys[col]);
+            http_printf(&body, ":%g", sums[col]);
+        }
+        http_put(&body, "}}", 2);
+    } else if (strcmp(target, "/stats") == 0) {
+        char stats[1024];
+        pressure_stats(stats, sizeof stats);
+        http_printf(&body, "%s", stats);
+    } else if (strcmp(target, "/next") == 0) {
+        char nbuf[16];
+        http_param(query, "n", nbuf, sizeof nbuf);
+        int want = nbuf[0] ? atoi(nbuf) : 10;
+        if (want < 0) want = 0;
+        if (want > MAX_TODOS) want = MAX_TODOS;
+        next_check_day();
+        int n = ih_top_n(&next_heap, ids, want);
+        http_put(&body, "[", 1);
+        for (int i = 0; i < n; ++i) {
+            http_printf(&body, "%s{\"score\":%.2f,\"todo\":", i ? "," : "", next_heap.key[ids[i]]);
+            http_todo_json(&body, todo_by_id(ids[i]));
+            http_put(&body, "}", 1);
+        }
+        http_put(&body, "]", 1);
+    } else {
+        status = 404;
+        http_printf(&body, "{\"error\":\"not found\"}");
+    }
+
+    http_respond(c, status, "application/json", &body);
+    free(body.out);
+}
+
+static void http_read(HttpClient *c)
+{
+    ssize_t n = recv(c->fd, c->in + c->in_len, sizeof c->in - c->in_len, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        http_close(c);
+        return;
+    }
+    if (n < 0) return;
+    c->in_len += n;
+
+    // handle every complete request in the buffer (pipelining)
+    char *end;
+    while (!c->events && !c->closing &&
+           (end = memmem(c->in, c->in_len, "\r\n\r\n", 4)) != NULL) {
+        *end = '\0';
+        char method[8] = "", target[1024] = "";
+        sscanf(c->in, "%7s %1023s", method, target);
+        c->closing = strcasestr(c->in, "\nConnection: close") != NULL ||
+                     strstr(c->in, "HTTP/1.0") != NULL;
+        http_route(c, method, target);
+
+        size_t used = (size_t)(end + 4 - c->in);
+        memmove(c->in, c->in + used, c->in_len - used);
+        c->in_len -= used;
+    }
+    if (c->in_len == sizeof c->in) {
+        c->closing = true;   /* header too large */
+        c->in_len = 0;
+    }
+    http_flush(c);
+}
+
+static void http_start(void)
+{
+    for (int i = 0; i < MAX_CLIENTS; ++i) http_clients[i].fd = -1;
+    if (!http_port) return;
+
+    http_listen = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    setsockopt(http_listen, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(http_port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(http_listen, (struct sockaddr *)&addr, sizeof addr) != 0 ||
+        listen(http_listen, 16) != 0) {
+        perror("http");
+        exit(1);
+    }
+}
+
+/* adds the server's fds to fds[], returns how many */
+static int http_poll_fds(struct pollfd *fds)
+{
+    int n = 0;
+    if (http_listen < 0) return 0;
+    fds[n++] = (struct pollfd){ .fd = http_listen, .events = POLLIN };
+    for (int i = 0; i < MAX_CLIENTS; ++i) {
+        HttpClient *c = &http_clients[i];
+        if (c->fd < 0) continue;
+        fds[n++] = (struct pollfd){ .fd = c->fd,
+                                    .events = POLLIN | (c->out_len ? POLLOUT : 0) };
+    }
+    return n;
+}
+
+static void http_handle(const struct pollfd *fds, int n)
+{
+    for (int i = 0; i < n; ++i) {
+        if (!fds[i].revents) continue;
+
+        if (fds[i].fd == http_listen) {
+            int fd;
+            while ((fd = accept4(http_listen, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                int slot = 0;
+                while (slot < MAX_CLIENTS && http_clients[slot].fd >= 0) slot++;
+                if (slot == MAX_CLIENTS) { close(fd); continue; }
+                http_clients[slot].fd = fd;
+            }
+            continue;
+        }
+
+        for (int k = 0; k < MAX_CLIENTS; ++k) {
+            HttpClient *c = &http_clients[k];
+            if (c->fd != fds[i].fd) continue;
+            if (fds[i].revents & (POLLERR | POLLHUP)) http_close(c);
+            else if (fds[i].revents & POLLIN) http_read(c);
+            else if (fds[i].revents & POLLOUT) http_flush(c);
+            break;
+        }
+    }
+}
+
+/* one event per batch of changes, whatever the number of edits */
+static void http_publish(void)
+{
+    if (store_revision == http_sent_revision) return;
+    http_sent_revision = store_revision;
+
+    for (int i = 0; i < MAX_CLIENTS; ++i) {
+        HttpClient *c = &http_clients[i];
+        if (c->fd < 0 || !c->events) continue;
+        // a client that stopped reading is dropped, not buffered for
+        if (c->out_len - c->out_off > HTTP_SSE_MAX) { http_close(c); continue; }
+        http_printf(c, "event: change\ndata: {\"revision\":%lu}\n\n", store_revision);
+        http_flush(c);
+    }
+}
+
+/*
+ * getch() that keeps the http server going while waiting. Returns ERR
+ * after timeout_ms without a key so the caller can do periodic work.
+ */
+static int wait_key(int timeout_ms)
+{
+    struct pollfd fds[4 + MAX_CLIENTS];
+    long deadline = now_ms() + timeout_ms;
+
+    for (;;) {
+        http_publish();
+
+        // ncurses may already hold buffered input poll() can't see
+        timeout(0);
+        int ch = getch();
+        timeout(-1);
+        if (ch != ERR) return ch;
+
+        long left = deadline - now_ms();
+        if (left <= 0) return ERR;
+
+        fds[0] = (struct pollfd){ .fd = STDIN_FILENO, .events = POLLIN };
+        int n = 1 + http_poll_fds(fds + 1);
+        int m = n;
+        if (mail_fd >= 0) fds[m++] = (struct pollfd){ .fd = mail_fd, .events = POLLIN };
+        if (pressure_fd >= 0) fds[m++] = (struct pollfd){ .fd = pressure_fd, .events = POLLPRI };
+        int ready = poll(fds, m, (int)left);
+        if (ready == 0) return ERR;
+        if (ready > 0) http_handle(fds + 1, n - 1);
+        if (pressure_fd >= 0 && (fds[m - 1].revents & POLLPRI)) pressure_event();
+        if (mail_fd >= 0 && fds[n].revents) return ERR;   // new mail: let the caller ingest it
+    }
+}
+
+/* ──────────────────────────────────────────────────────── analytics ── */
+
+/*
+ * Throughput, cycle time and aging, computed from packed columns of day
+ * numbers rather than from text. The archive is read into its columns once
+ * and afterwards only the part appended since the last read is parsed; the
+ * live list is packed again each time the panel opens. The aggregation
+ * loops run over plain int arrays so the compiler can vectorize them.
+ */
+#define AN_MAX_CTX   64
+#define AN_MAX_CYCLE 365             /* longer cycle times are clamped */
+#define AN_WIDTH     14              /* buckets in the throughput chart */
+
+typedef struct {
+    int         *created, *done;     /* day numbers, -1 if unknown */
+    signed char *ctx;                /* index into an_ctx, -1 for overflow */
+    char        *prio;               /* 'A'..'Z', 0 for none */
+    int          n, cap;
+} DateColumns;
+
+static DateColumns an_archive, an_live;
+static long        an_archive_offset = 0;     /* bytes of archive already read */
+static char        an_ctx[AN_MAX_CTX][MAX_TYPE];
+static int         an_ctx_count = 0;
+static bool        show_analytics = false;
+static bool        an_weekly = false;
+
+static int an_ctx_index(const char *type)
+{
+    for (int i = 0; i < an_ctx_count; ++i)
+        if (strcmp(an_ctx[i], type) == 0) return i;
+    if (an_ctx_count == AN_MAX_CTX) return -1;
+    snprintf(an_ctx[an_ctx_count], MAX_TYPE, "%s", type);
+    return an_ctx_count++;
+}
+
+static void an_push(DateColumns *c, const Todo *t)
+{
+    if (c->n == c->cap) {
+        c->cap = c->cap ? c->cap * 2 : 1024;
+        c->created = realloc(c->created, c->cap * sizeof *c->created);
+        c->done    = realloc(c->done,    c->cap * sizeof *c->done);
+        c->ctx     = realloc(c->ctx,     c->cap * sizeof *c->ctx);
+        c->prio    = realloc(c->prio,    c->cap * sizeof *c->prio);
+    }
+    c->created[c->n] = day_number(t->date);
+    c->done[c->n]    = t->completed ? day_number(t->completion_date) : -1;
+    c->ctx[c->n]     = (signed char)an_ctx_index(t->type);
+
+    // a completed item keeps its priority as a trailing pri:X
+    const char *pri = strstr(t->text, " pri:");
+    int p = toupper((unsigned char)(t->priority[0] == '(' ? t->priority[1] : pri ? pri[5] : 0));
+    c->prio[c->n] = p >= 'A' && p <= 'Z' ? (char)p : 0;   // indexes an_cycle_hist
+    c->n++;
+}
+
+static size_t an_bytes(void)
+{
+    size_t per = sizeof(int) * 2 + sizeof(signed char) + sizeof(char);
+    return (size_t)(an_archive.cap + an_live.cap) * per;
+}
+
+/* the archive columns are read again, from the start, next time the panel opens */
+static void an_shed(void)
+{
+    DateColumns *cols[2] = { &an_archive, &an_live };
+    for (int i = 0; i < 2; ++i) {
+        free(cols[i]->created);
+        free(cols[i]->done);
+        free(cols[i]->ctx);
+        free(cols[i]->prio);
+        *cols[i] = (DateColumns){ 0 };
+    }
+    an_archive_offset = 0;
+}
+
+/* parse only what was appended to the archive since the last call */
+static void an_load_archive(void)
+{
+    char path[PATH_MAX];
+    sidecar_path(path, sizeof path, "todo.archive.txt");
+    FILE *f = store_open(path);
+    if (!f) return;
+
+    // the length of the text, which for a sealed archive is not the file's
+    fseek(f, 0, SEEK_END);
+    if (ftell(f) < an_archive_offset) {
+        an_archive.n = 0;              /* rewritten or truncated */
+        an_archive_offset = 0;
+    }
+    fseek(f, an_archive_offset, SEEK_SET);
+
+    char line[MAX_LINE];
+    Todo t;
+    while (fgets(line, sizeof line, f)) {
+        if (!strchr(line, '\n') && !feof(f)) continue;
+        line[strcspn(line, "\r\n")] = '\0';
+        parse_todo_line(line, &t);
+        an_push(&an_archive, &t);
+    }
+    an_archive_offset = ftell(f);
+    fclose(f);
+}
+
+static void an_pack_live(Todo *t, void *arg)
+{
+    (void)arg;
+    an_push(&an_live, t);
+}
+
+/* items done in [from, to) */
+static int an_count_done(const DateColumns *c, int from, int to)
+{
+    int count = 0;
+    const int *done = c->done;
+    for (int i = 0; i < c->n; ++i)
+        count += (done[i] >= from) & (done[i] < to);
+    return count;
+}
+
+static int an_cycle_hist[AN_MAX_CTX + 27][AN_MAX_CYCLE + 1];
+
+/* one histogram row per context and per priority (26 = none) */
+static void an_cycle_histograms(const DateColumns *c)
+{
+    for (int i = 0; i < c->n; ++i) {
+        if (c->done[i] < 0 || c->created[i] < 0) continue;
+        int cycle = c->done[i] - c->created[i];
+        if (cycle < 0) cycle = 0;
+        if (cycle > AN_MAX_CYCLE) cycle = AN_MAX_CYCLE;
+        if (c->ctx[i] >= 0) an_cycle_hist[(int)c->ctx[i]][cycle]++;
+        an_cycle_hist[AN_MAX_CTX + (c->prio[i] ? c->prio[i] - 'A' : 26)][cycle]++;
+    }
+}
+
+static int an_percentile(const int *hist, int total, int pct)
+{
+    int want = (total * pct + 99) / 100, seen = 0;
+    for (int d = 0; d <= AN_MAX_CYCLE; ++d)
+        if ((seen += hist[d]) >= want) return d;
+    return AN_MAX_CYCLE;
+}
+
+static void an_cycle_row(int *row, const char *label, const int *hist)
+{
+    int total = 0;
+    for (int d = 0; d <= AN_MAX_CYCLE; ++d) total += hist[d];
+    if (!total || *row >= LINES - 1) return;
+
+    mvprintw((*row)++, 2, "%-20.20s %6d %6d %6d", label, total,
+             an_percentile(hist, total, 50), an_percentile(hist, total, 90));
+}
+
+static void draw_analytics_panel(void)
+{
+    an_load_archive();
+    an_live.n = 0;
+    for_each_todo(an_pack_live, NULL);
+
+    int today = today_number();
+    int span = an_weekly ? 7 : 1;
+    int row = 0;
+
+    attron(COLOR_PAIR(2) | A_BOLD);
+    mvprintw(row, 0, "   Analytics");
+    attroff(COLOR_PAIR(2) | A_BOLD);
+    printw("  (%d live, %d archived; d/w: days/weeks, any other key closes)",
+           an_live.n, an_archive.n);
+    mvhline(++row, 0, '-', COLS);
+    row++;
+
+    /* throughput */
+    attron(A_BOLD);
+    mvprintw(row++, 2, "Done per %s", an_weekly ? "week" : "day");
+    attroff(A_BOLD);
+
+    int counts[AN_WIDTH], max = 1;
+    for (int b = 0; b < AN_WIDTH; ++b) {
+        int to = today + 1 - b * span;
+        counts[b] = an_count_done(&an_live, to - span, to) +
+                    an_count_done(&an_archive, to - span, to);
+        if (counts[b] > max) max = counts[b];
+    }
+    for (int b = AN_WIDTH - 1; b >= 0 && row < LINES - 1; --b) {
+        time_t when = time(NULL) - (time_t)b * span * 86400;
+        char label[16];
+        strftime(label, sizeof label, "%m-%d", localtime(&when));
+        int bar = counts[b] * (COLS - 20 > 0 ? COLS - 20 : 1) / max;
+        mvprintw(row, 4, "%s %4d ", label, counts[b]);
+        attron(COLOR_PAIR(3));
+        for (int i = 0; i < bar; ++i) addch('#');
+        attroff(COLOR_PAIR(3));
+        row++;
+    }
+
+    /* cycle time */
+    memset(an_cycle_hist, 0, sizeof an_cycle_hist);
+    an_cycle_histograms(&an_live);
+    an_cycle_histograms(&an_archive);
+
+    row++;
+    attron(A_BOLD);
+    mvprintw(row++, 2, "%-20s %6s %6s %6s", "Cycle time (days)", "n", "p50", "p90");
+    attroff(A_BOLD);
+    for (int c = 0; c < an_ctx_count; ++c) {
+        char label[MAX_TYPE + 1];
+        snprintf(label, sizeof label, "@%s", an_ctx[c]);
+        an_cycle_row(&row, label, an_cycle_hist[c]);
+    }
+    for (int p = 0; p <= 26; ++p) {
+        char label[8];
+        snprintf(label, sizeof label, p < 26 ? "(%c)" : "no prio", 'A' + p);
+        an_cycle_row(&row, label, an_cycle_hist[AN_MAX_CTX + p]);
+    }
+
+    /* aging of open items */
+    static const int limits[] = { 7, 30, 90, 1 << 30 };
+    int aging[4] = {0};
+    for (int i = 0; i < an_live.n; ++i) {
+        if (an_live.done[i] >= 0 || an_live.created[i] < 0) continue;
+        int age = today - an_live.created[i], b = 0;
+        while (age > limits[b]) b++;
+        aging[b]++;
+    }
+    if (row + 2 < LINES) {
+        row++;
+        attron(A_BOLD);
+        mvprintw(row++, 2, "Open items by age");
+        attroff(A_BOLD);
+        mvprintw(row++, 4, "0-7d %d   8-30d %d   31-90d %d   >90d %d",
+                 aging[0], aging[1], aging[2], aging[3]);
+    }
+}
+
+/* ─────────────────────────────────────────────────────────── keymap ── */
+
+/*
+ * Keys are looked up in a dense table indexed by the getch() value, so
+ * dispatch is one array read. Multi-key sequences ("gg") turn their first
+ * key into a prefix pointing at a small trie of follow-up keys. Defaults
+ * are below; ~/.config/nntm/keymap (or --keymap FILE) overrides them with
+ * lines of "<keys> <action>", read once at startup.
+ */
+enum {
+    ACT_NONE, ACT_QUIT, ACT_TOGGLE, ACT_HELP, ACT_NEXT, ACT_ANALYTICS,
+    ACT_PRIORITY, ACT_SORT_PRIO, ACT_SORT_PRIO_DESC, ACT_DOWN, ACT_UP,
+    ACT_MOVE_DOWN, ACT_MOVE_UP, ACT_MOVE_TOP, ACT_INSERT_MODE,
+    ACT_PREV_CONTEXT, ACT_NEXT_CONTEXT, ACT_SORT_DATE, ACT_SORT_DATE_DESC,
+    ACT_GROUP, ACT_RESTORE_ORDER, ACT_ADD, ACT_JUMP_CONTEXT, ACT_ARCHIVE,
+    ACT_RETYPE, ACT_TOP, ACT_BOTTOM, ACT_FILTER, ACT_FIND_FILES, ACT_NOTES,
+    ACT_FOLD, ACT_INDENT, ACT_OUTDENT, ACT_REPLACE, ACT_UNDO, ACT_COUNT
+};
+
+static const char *action_names[ACT_COUNT] = {
+    "none", "quit", "toggle", "help", "next_actions", "analytics",
+    "priority", "sort_priority", "sort_priority_desc", "down", "up",
+    "move_down", "move_up", "move_top", "insert_mode",
+    "prev_context", "next_context", "sort_date", "sort_date_desc",
+    "group", "restore_order", "add", "jump_context", "archive",
+    "retype", "top", "bottom", "filter", "find_files", "notes",
+    "fold", "indent", "outdent", "replace", "undo",
+};
+
+#define MAX_KEY_NODES 256
+
+/* trie node for the second and later keys of a sequence */
+typedef struct { int key, action, child, sibling; } KeyNode;
+
+static int     keymap[KEY_MAX + 1];          /* action, or -(node + 1) */
+static KeyNode key_nodes[MAX_KEY_NODES];
+static int     key_node_count = 0;
+static const char *keymap_file = NULL;
+
+static const struct { const char *keys; int action; } default_bindings[] = {
+    { "q", ACT_QUIT },        { "<space>", ACT_TOGGLE },  { "?", ACT_HELP },
+    { "N", ACT_NEXT },        { "a", ACT_ANALYTICS },     { "s", ACT_PRIORITY },
+    { "p", ACT_SORT_PRIO },   { "P", ACT_SORT_PRIO_DESC },
+    { "j", ACT_DOWN },        { "k", ACT_UP },
+    { "<down>", ACT_DOWN },   { "<up>", ACT_UP },
+    { "J", ACT_MOVE_DOWN },   { "K", ACT_MOVE_UP },       { "T", ACT_MOVE_TOP },
+    { "I", ACT_INSERT_MODE },
+    { "h", ACT_PREV_CONTEXT },{ "l", ACT_NEXT_CONTEXT },
+    { "d", ACT_SORT_DATE },   { "D", ACT_SORT_DATE_DESC },
+    { "gc", ACT_GROUP },      { "O", ACT_RESTORE_ORDER },
+    { "n", ACT_ADD },         { "@", ACT_JUMP_CONTEXT },  { "A", ACT_ARCHIVE },
+    { "t", ACT_RETYPE },      { "<home>", ACT_TOP },      { "<end>", ACT_BOTTOM },
+    { "gg", ACT_TOP },        { "G", ACT_BOTTOM },        // as in vim
+    { "/", ACT_FILTER },      { "F", ACT_FIND_FILES },    { "o", ACT_NOTES },
+    { "z", ACT_FOLD },        { ">", ACT_INDENT },        { "<", ACT_OUTDENT },
+    { "R", ACT_REPLACE },     { "u", ACT_UNDO },
+};
+
+/* next key of a spec like "gg", "<C-d>", "<space>"; 0 at the end, -1 bad */
+static int parse_key(const char **spec)
+{
+    static const struct { const char *name; int key; } named[] = {
+        { "space", ' ' },   { "enter", '\n' },     { "tab", '\t' },
+        { "esc", 27 },      { "bs", KEY_BACKSPACE }, { "del", KEY_DC },
+        { "up", KEY_UP },   { "down", KEY_DOWN },  { "left", KEY_LEFT },
+        { "right", KEY_RIGHT }, { "home", KEY_HOME }, { "end", KEY_END },
+        { "pgup", KEY_PPAGE }, { "pgdn", KEY_NPAGE }, { "lt", '<' },
+    };
+    const char *p = *spec;
+    if (!*p) return 0;
+
+    if (*p == '<' && p[1] && strchr(p, '>')) {
+        const char *end = strchr(p, '>');
+        size_t len = end - p - 1;
+        *spec = end + 1;
+        if (len == 3 && (p[1] == 'C' || p[1] == 'c') && p[2] == '-')
+            return p[3] & 0x1f;
+        for (size_t i = 0; i < sizeof named / sizeof *named; ++i)
+            if (strlen(named[i].name) == len && strncasecmp(p + 1, named[i].name, len) == 0)
+                return named[i].key;
+        return -1;
+    }
+    *spec = p + 1;
+    return (unsigned char)*p;
+}
+
+static int key_child(int node, int key)
+{
+    for (int c = key_nodes[node].child; c >= 0; c = key_nodes[c].sibling)
+        if (key_nodes[c].key == key) return c;
+    return -1;
+}
+
+static bool bind_keys(const char *spec, int action)
+{
+    int keys[8], n = 0, k;
+    while (n < 8 && (k = parse_key(&spec)) > 0 && k <= KEY_MAX) keys[n++] = k;
+    if (n == 0 || k < 0 || *spec) return false;
+
+    if (n == 1) {
+        keymap[keys[0]] = action;
+        return true;
+    }
+
+    // the first key becomes a prefix, dropping its single-key binding
+    if (keymap[keys[0]] >= 0) {
+        if (key_node_count == MAX_KEY_NODES) return false;
+        key_nodes[key_node_count] = (KeyNode){ keys[0], ACT_NONE, -1, -1 };
+        keymap[keys[0]] = -(key_node_count++) - 1;
+    }
+
+    int node = -keymap[keys[0]] - 1;
+    for (int i = 1; i < n; ++i) {
+        int c = key_child(node, keys[i]);
+        if (c < 0) {
+            if (key_node_count == MAX_KEY_NODES) return false;
+            c = key_node_count++;
+            key_nodes[c] = (KeyNode){ keys[i], ACT_NONE, -1, key_nodes[node].child };
+            key_nodes[node].child = c;
+        }
+        node = c;
+    }
+    key_nodes[node].action = action;
+    return true;
+}
+
+static void load_keymap(void)
+{
+    for (size_t i = 0; i < sizeof default_bindings / sizeof *default_bindings; ++i)
+        bind_keys(default_bindings[i].keys, default_bindings[i].action);
+
+    char path[PATH_MAX];
+    if (keymap_file) {
+        snprintf(path, sizeof path, "%s", keymap_file);
+    } else {
+        const char *xdg = getenv("XDG_CONFIG_HOME"), *home = getenv("HOME");
+        if (xdg && *xdg) snprintf(path, sizeof path, "%s/nntm/keymap", xdg);
+        else if (home)   snprintf(path, sizeof path, "%s/.config/nntm/keymap", home);
+        else return;
+    }
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        if (keymap_file) { perror(keymap_file); exit(1); }
+        return;
+    }
+
+    char line[256];
+    for (int lineno = 1; fgets(line, sizeof line, f); ++lineno) {
+        char keys[64], name[64];
+        if (sscanf(line, "%63s %63s", keys, name) != 2 || keys[0] == '#') continue;
+
+        int action = -1;
+        for (int a = 0; a < ACT_COUNT; ++a)
+            if (strcmp(action_names[a], name) == 0) action = a;
+        if (action < 0 || !bind_keys(keys, action))
+            fprintf(stderr, "%s:%d: cannot bind '%s' to '%s'\n", path, lineno, keys, name);
+    }
+    fclose(f);
+}
+
+/*
+ * Feed one key; returns the action, or -1 while a sequence is incomplete.
+ * *pending carries the trie position (node + 1) between calls.
+ */
+static int key_action(int ch, int *pending)
+{
+    int node;
+    if (*pending) {
+        node = key_child(*pending - 1, ch);
+        *pending = 0;
+        if (node < 0) return ACT_NONE;
+    } else {
+        if (ch < 0 || ch > KEY_MAX) return ACT_NONE;
+        if (keymap[ch] >= 0) return keymap[ch];
+        node = -keymap[ch] - 1;
+    }
+
+    if (key_nodes[node].child >= 0) {
+        *pending = node + 1;
+        return -1;
+    }
+    return key_nodes[node].action;
+}
+
+static void key_label(int key, char *buf, size_t size)
+{
+    switch (key) {
+    case ' ':           snprintf(buf, size, "SPACE"); return;
+    case '\n':          snprintf(buf, size, "ENTER"); return;
+    case '\t':          snprintf(buf, size, "TAB");   return;
+    case 27:            snprintf(buf, size, "ESC");   return;
+    case KEY_UP:        snprintf(buf, size, "UP");    return;
+    case KEY_DOWN:      snprintf(buf, size, "DOWN");  return;
+    case KEY_LEFT:      snprintf(buf, size, "LEFT");  return;
+    case KEY_RIGHT:     snprintf(buf, size, "RIGHT"); return;
+    case KEY_HOME:      snprintf(buf, size, "HOME");  return;
+    case KEY_END:       snprintf(buf, size, "END");   return;
+    case KEY_PPAGE:     snprintf(buf, size, "PGUP");  return;
+    case KEY_NPAGE:     snprintf(buf, size, "PGDN");  return;
+    case KEY_DC:        snprintf(buf, size, "DEL");   return;
+    case KEY_BACKSPACE: snprintf(buf, size, "BS");    return;
+    }
+    if (key < 32) snprintf(buf, size, "C-%c", key + 'a' - 1);
+    else if (key < 256) snprintf(buf, size, "%c", key);
+    else snprintf(buf, size, "#%d", key);
+}
+
+static void keys_append(char *out, size_t size, const char *prefix, int key)
+{
+    char name[16];
+    key_label(key, name, sizeof name);
+    size_t len = strlen(out);
+    snprintf(out + len, size - len, "%s%s%s", len ? " " : "", prefix, name);
+}
+
+static void keys_walk(int node, const char *prefix, int action, char *out, size_t size)
+{
+    char path[32];
+    for (int c = key_nodes[node].child; c >= 0; c = key_nodes[c].sibling) {
+        char name[16];
+        key_label(key_nodes[c].key, name, sizeof name);
+        snprintf(path, sizeof path, "%s%s", prefix, name);
+        if (key_nodes[c].child >= 0) keys_walk(c, path, action, out, size);
+        else if (key_nodes[c].action == action) keys_append(out, size, prefix, key_nodes[c].key);
+    }
+}
+
+/* every key or sequence bound to action, space separated (for the help) */
+static void keys_for_action(int action, char *out, size_t size)
+{
+    out[0] = '\0';
+    for (int k = 0; k <= KEY_MAX; ++k) {
+        if (keymap[k] == action) {
+            keys_append(out, size, "", k);
+        } else if (keymap[k] < 0) {
+            char name[16];
+            key_label(k, name, sizeof name);
+            keys_walk(-keymap[k] - 1, name, action, out, size);
+        }
+    }
+}
+
+/* ───────────────────────────────────────────── UI ── */
+
+/* ranked "what to do now" across every context, top rows of next_heap */
+static void draw_next_panel(void)
+{
+    static int ids[MAX_TODOS];
+    int rows = LINES - 2;
+    if (rows < 0) rows = 0;
+    int n = ih_top_n(&next_heap, ids, rows);
+
+    if (next_selected >= n) next_selected = n > 0 ? n - 1 : 0;
+
+    attron(COLOR_PAIR(2) | A_BOLD);
+    mvprintw(0, 0, "   Next actions");
+    attroff(COLOR_PAIR(2) | A_BOLD);
+    printw("  (%d open, ENTER jumps, any other key closes)", next_heap.n);
+
+    double sums[MAX_TAG_COLS];
+    tags_totals(ids, n, sums);
+    for (int c = 0; c < tag_col_count; ++c) {
+        char val[32];
+        format_tag_value(val, sizeof val, c, sums[c]);
+        printw("   %s %s", tag_keys[c], val);
     }
+    mvhline(1, 0, '-', COLS);
 
-    sort_descending = descending;
-    qsort(sorted, count, sizeof(Todo), compare_priority);
+    for (int r = 0; r < n; ++r) {
+        Todo *t = todo_by_id(ids[r]);
+        if (!t) continue;
+        bool is_sel = (r == next_selected);
 
-    // reinsert sorted section
-    int j = 0;
-    for (int i = 0; i < todo_count; ++i) {
-        if (strcmp(types[selected_type], "all") == 0 ||
-            strcmp(todos[i].type, types[selected_type]) == 0)
-        {
-            todos[i] = sorted[j++];
-        }
+        attron(is_sel ? (COLOR_PAIR(4) | A_BOLD) : COLOR_PAIR(3));
+        mvprintw(r + 2, 2, "%5.1f", next_heap.key[ids[r]]);
+        attroff(is_sel ? (COLOR_PAIR(4) | A_BOLD) : COLOR_PAIR(3));
+
+        mvprintw(r + 2, 9, "%-4s", t->priority);
+        mvaddch(r + 2, 14, '@' | COLOR_PAIR(10) | A_DIM);
+        attron(COLOR_PAIR(strcmp(t->type, "all") == 0 ? 9 : 8));
+        printw("%-8s", t->type);
+        attroff(COLOR_PAIR(strcmp(t->type, "all") == 0 ? 9 : 8));
+
+        attron(is_sel ? (COLOR_PAIR(1) | A_BOLD) : COLOR_PAIR(1));
+        mvprintw(r + 2, 24, "%s", t->text);
+        attroff(is_sel ? (COLOR_PAIR(1) | A_BOLD) : COLOR_PAIR(1));
     }
 }
 
+static bool  show_notes = false;
+static int   notes_item = -1;       /* id of the item whose note is shown */
+static char *notes_body = NULL;
+static bool  notes_no_room = false; /* last edit dropped: no room for an id: tag */
 
+/* `o`: show the selected item's note (read from the sidecar only now) */
+static void open_notes(void)
+{
+    Todo *t = view_at(selected_index);
+    if (!t) return;
+    char key[ITEM_KEY];
+    free(notes_body);
+    notes_body = item_key_of(t, key) ? notes_read(key) : NULL;
+    notes_item = t->id;
+    notes_no_room = false;
+    show_notes = true;
+}
 
-static void prompt_priority(void)
+/* `e` in the notes pane: edit the note in $VISUAL / $EDITOR */
+static void edit_notes(void)
 {
-    int shown = 0;
-    for (int i = 0; i < todo_count; ++i) {
-        Todo *t = &todos[i];
-if (strcmp(types[selected_type], "all") != 0 &&
-    strcmp(t->type, types[selected_type]) != 0) continue;
-
-
-        if (shown == selected_index) {
-            if (t->completed) {
-                mvprintw(LINES - 1, 0, "❌ Cannot set priority on completed item.");
-                refresh();
-                napms(1000); // wait 1 second
-                move(LINES - 1, 0);
-                clrtoeol();
-                refresh();
-                return;
-            }
+    Todo *t = todo_by_id(notes_item);
+    if (!t || crypt_on) return;         // todo.notes is not sealed
+
+    char path[] = "/tmp/nntm-note-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return;
+    size_t old_len = notes_body ? strlen(notes_body) : 0;
+    if (old_len && write(fd, notes_body, old_len) != (ssize_t)old_len) {
+        close(fd);
+        unlink(path);
+        return;
+    }
+    close(fd);
 
-            // Prompt user
-            echo();
-            curs_set(1);
-            mvprintw(LINES - 1, 0, "Set priority (a-z, or space to clear): ");
-            int ch = getch();
-            noecho();
-            curs_set(0);
-
-            if (ch == ' ' || ch == KEY_BACKSPACE || ch == 127) {
-                t->priority[0] = '\0'; // clear
-            } else if (isalpha(ch)) {
-                ch = toupper(ch);
-                snprintf(t->priority, sizeof t->priority, "(%c)", ch);
-            }
+    const char *editor = getenv("VISUAL");
+    if (!editor || !*editor) editor = getenv("EDITOR");
+    if (!editor || !*editor) editor = "vi";
 
-            save_todos_to_file();
+    def_prog_mode();
+    endwin();
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl("/bin/sh", "sh", "-c", "exec $0 \"$1\"", editor, path, (char *)NULL);
+        _exit(127);
+    }
+    int status = 0;
+    if (pid > 0) waitpid(pid, &status, 0);
+    reset_prog_mode();
+    refresh();
+
+    FILE *f = fopen(path, "r");
+    char *body = NULL;
+    size_t cap = 0;
+    long len = 0;
+    if (f) {
+        FILE *mem = open_memstream(&body, &cap);
+        char buf[4096];
+        size_t n;
+        while (mem && (n = fread(buf, 1, sizeof buf, f)) > 0) fwrite(buf, 1, n, mem);
+        if (mem) fclose(mem);
+        fclose(f);
+        len = body ? (long)strlen(body) : 0;
+    }
+    unlink(path);
 
-            move(LINES - 1, 0);
-            clrtoeol();
-            refresh();
+    bool changed = (size_t)len != old_len || (len && memcmp(body, notes_body, len) != 0);
+    if (pid > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && changed) {
+        char key[ITEM_KEY];
+        if ((len > 0 || item_key_of(t, key)) && item_key_assign(t, key)) {
+            notes_write(key, body, len);
+            save_todos_to_file();
+        } else if (len > 0) {
+            free(body);                 // without an id: tag the note would be orphaned
+            notes_no_room = true;
             return;
         }
-
-        ++shown;
+        free(notes_body);
+        notes_body = len > 0 ? body : NULL;
+        if (len == 0) free(body);
+    } else {
+        free(body);
     }
 }
 
-
-
-
-static void add_type(const char *type)
+static void draw_notes_panel(void)
 {
-    for (int i = 0; i < type_count; ++i)
-        if (strcmp(types[i], type) == 0) return;
-    types[type_count++] = strdup(type);
+    Todo *t = todo_by_id(notes_item);
+    attron(COLOR_PAIR(2) | A_BOLD);
+    mvprintw(0, 0, "   Notes");
+    attroff(COLOR_PAIR(2) | A_BOLD);
+    printw("  %s", t ? t->text : "");
+    mvhline(1, 0, '-', COLS);
+
+    if (notes_no_room) {
+        attron(COLOR_PAIR(5));
+        mvprintw(LINES - 1, 2, "note not saved: the item text has no room for an id: tag");
+        attroff(COLOR_PAIR(5));
+    }
+    if (!notes_body) {
+        attron(COLOR_PAIR(5));
+        mvprintw(2, 2, crypt_on ? "(no notes; notes are not sealed, so they are off for a sealed list)"
+                                : "(no notes, e to write one, any other key closes)");
+        attroff(COLOR_PAIR(5));
+        return;
+    }
+    int row = 2;
+    for (const char *p = notes_body; *p && row < LINES - 1; ++row) {
+        int n = (int)strcspn(p, "\n");
+        mvprintw(row, 2, "%.*s", n < COLS - 2 ? n : COLS - 2, p);
+        p += n;
+        if (*p == '\n') ++p;
+    }
+    if (notes_no_room) return;
+    attron(COLOR_PAIR(5));
+    mvprintw(LINES - 1, 2, crypt_on ? "read only while the list is sealed, any key closes"
+                                    : "e edits, any other key closes");
+    attroff(COLOR_PAIR(5));
 }
 
-static int count_visible_items_for_type(const char *type)
-{
-    if (strcmp(type, "all") == 0)
-        return todo_count;
+static bool show_grep = false;
+static int  grep_selected = 0;
+static char grep_root[PATH_MAX];
 
-    int n = 0;
-    for (int i = 0; i < todo_count; ++i)
-        if (strcmp(todos[i].type, type) == 0) ++n;
-    return n;
+/* `F`: search every todo file and archive next to (and below) this one */
+static void prompt_grep(void)
+{
+    char text[MAX_LINE];
+    prompt_line("Find in files: ", text, sizeof text, false);
+    if (!text[0]) return;
+
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof tmp, "%s", todo_filename);
+    snprintf(grep_root, sizeof grep_root, "%s", dirname(tmp));
+    grep_dir(text, grep_root);
+    grep_selected = 0;
+    show_grep = true;
 }
 
-
-static void prompt_type(void)
+static void draw_grep_panel(void)
 {
-    int shown = 0;
-    for (int i = 0; i < todo_count; ++i) {
-        Todo *t = &todos[i];
-        if (strcmp(types[selected_type], "all") != 0 &&
-            strcmp(t->type, types[selected_type]) != 0)
-            continue;
+    int rows = LINES - 2;
+    if (rows < 1) rows = 1;
+    if (grep_selected >= grep_total) grep_selected = grep_total > 0 ? grep_total - 1 : 0;
+    int first = grep_selected >= rows ? grep_selected - rows + 1 : 0;
 
-        if (shown == selected_index) {
-            // Prompt for new type
-            echo();
-            curs_set(1);
-            char input[MAX_TYPE] = {0};
-            move(LINES - 1, 0);
-            clrtoeol();
-            attron(COLOR_PAIR(2) | A_BOLD);
-            printw("Change type to @");
-            attroff(COLOR_PAIR(2) | A_BOLD);
-            getnstr(input, MAX_TYPE - 1);
-            noecho();
-            curs_set(0);
-
-            if (strlen(input) > 0) {
-                strncpy(t->type, input, MAX_TYPE - 1);
-                add_type(input);
-                save_todos_to_file();
-            }
+    attron(COLOR_PAIR(2) | A_BOLD);
+    mvprintw(0, 0, "   Find \"%s\"", grep_needle);
+    attroff(COLOR_PAIR(2) | A_BOLD);
+    printw("  (%d hits in %d files, any key but j/k closes)", grep_total, grep_nfiles);
+    mvhline(1, 0, '-', COLS);
 
-            move(LINES - 1, 0);
-            clrtoeol();
-            refresh();
-            return;
+    size_t skip = strlen(grep_root) + 1;
+    int k = 0, row = 2;
+    for (int f = 0; f < grep_nfiles && row < LINES; ++f) {
+        const GrepFile *gf = &grep_files[f];
+        const char *name = strlen(gf->path) > skip ? gf->path + skip : gf->path;
+        for (int h = 0; h < gf->n && row < LINES; ++h, ++k) {
+            if (k < first) continue;
+            const Todo *t = &gf->hits[h].todo;
+            bool is_sel = (k == grep_selected);
+
+            attron(is_sel ? (COLOR_PAIR(4) | A_BOLD) : COLOR_PAIR(6));
+            mvprintw(row, 2, "%s:%ld", name, gf->hits[h].line);
+            attroff(is_sel ? (COLOR_PAIR(4) | A_BOLD) : COLOR_PAIR(6));
+
+            printw("  %s %-3s ", t->completed ? "x" : " ", t->priority);
+            attron(COLOR_PAIR(strcmp(t->type, "all") == 0 ? 9 : 8));
+            printw("@%-8s", t->type);
+            attroff(COLOR_PAIR(strcmp(t->type, "all") == 0 ? 9 : 8));
+            attron(t->completed ? (COLOR_PAIR(5) | A_DIM) : COLOR_PAIR(1));
+            printw(" %s", t->text);
+            attroff(t->completed ? (COLOR_PAIR(5) | A_DIM) : COLOR_PAIR(1));
+            ++row;
         }
-
-        ++shown;
     }
 }
-/* ─────────────────────────────────────────────── file I/O ── */
 
-void load_todos(const char *filename) {
-    FILE *f = fopen(filename, "r");
-    if (!f) {
-        perror("open");
-        exit(1);
-    }
-    // Clear current todos and types
-	// In case we run it again
-    todo_count = 0;
-    for (int i = 0; i < type_count; ++i) {
-        free(types[i]);
-    }
-	
-    type_count = 0;
-// After clearing types and todos, add the virtual type
-types[type_count++] = strdup("all");
+/* ──────────────────────────────────────────────────── render cache ── */
 
-    char line[MAX_LINE];
-    while (fgets(line, sizeof(line), f)) {
-        if (todo_count >= MAX_TODOS) break;
+/*
+ * Each list row is kept as a ready-made line of attributed cells, built
+ * the first time it is drawn and then copied to the screen as it is. A row
+ * is rebuilt only when something it shows has changed: the item itself
+ * (row_version), selection, width, indentation, subtree progress or
+ * whether the @context column is shown.
+ */
+#define LIST_DATE_COL 2
+#define LIST_PRIO_COL 13                 /* 2 + 10 + 1 */
 
-        // Trim trailing newlines
-        line[strcspn(line, "\r\n")] = '\0';
+typedef struct {
+    unsigned version;
+    int      width, depth, done, total;
+    bool     sel, all, folded, valid;
+    cchar_t *cells;                      /* one per cell, wide characters once */
+    int      n;
+} RowCache;
 
-        Todo *t = &todos[todo_count];
-        memset(t, 0, sizeof(Todo));
-        t->completed = false;
-
-        const char *p = line;
-
-        // 1. check if line starts with "x " (completed)
-        if (strncmp(p, "x ", 2) == 0) {
-            t->completed = true;
-            p += 2;
-            sscanf(p, "%10s", t->completion_date);
-            p += strlen(t->completion_date);
-            while (isspace((unsigned char)*p)) p++;
-        }
-
-        // 2. check for priority first (before date)
-        if (p[0] == '(' && isalpha((unsigned char)p[1]) && p[2] == ')') {
-            strncpy(t->priority, p, 3);
-            t->priority[3] = '\0';
-            p += 4;
-            while (isspace((unsigned char)*p)) p++;
-        } else {
-            t->priority[0] = '\0';
-        }
+static RowCache row_cache[MAX_TODOS];
 
-        // 3. extract date
-        sscanf(p, "%10s", t->date);
-        p += strlen(t->date);
-        while (isspace((unsigned char)*p)) p++;
+/* a row being built: one cell per column, row_cont marks the later columns of wide chars */
+static cchar_t       row_grid[1024];
+static unsigned char row_cont[1024];
+static int           row_width;
 
-        // 4. if priority wasn't found before, check again after date
-        if (t->priority[0] == '\0' && p[0] == '(' && isalpha((unsigned char)p[1]) && p[2] == ')') {
-            strncpy(t->priority, p, 3);
-            t->priority[3] = '\0';
-            p += 4;
-            while (isspace((unsigned char)*p)) p++;
-        }
-
-        // 5. extract @type
-        if (*p == '@') {
-            ++p;
-            sscanf(p, "%31s", t->type);
-            add_type(t->type);
-            p += strlen(t->type);
-            while (isspace((unsigned char)*p)) p++;
-        } else {
-            strcpy(t->type, "all");
-            add_type("all");
+static void row_set(int col, const wchar_t *wc, int w, attr_t attr)
+{
+    // a character that gets partly overwritten leaves a blank
+    if (row_cont[col]) {
+        int lead = col;
+        while (lead > 0 && row_cont[lead]) --lead;
+        setcchar(&row_grid[lead], L" ", A_NORMAL, 0, NULL);
+        for (int c = lead + 1; c < row_width && row_cont[c]; ++c) {
+            row_cont[c] = 0;
+            setcchar(&row_grid[c], L" ", A_NORMAL, 0, NULL);
         }
-
-        // 6. remaining is the text
-        strncpy(t->text, p, MAX_LINE - 1);
-        todo_count++;
     }
-
-    fclose(f);
+    for (int c = col + 1; c < row_width && row_cont[c]; ++c) {
+        row_cont[c] = 0;
+        setcchar(&row_grid[c], L" ", A_NORMAL, 0, NULL);
+    }
+    setcchar(&row_grid[col], wc, attr & ~A_COLOR, (short)PAIR_NUMBER(attr), NULL);
+    for (int c = col + 1; c < col + w; ++c) row_cont[c] = 1;
 }
 
-static void save_todos_to_file(void)
+/* put multibyte text at col like mvprintw would, clipped to the row; returns the next col */
+static int row_put(int col, const char *s, attr_t attr)
 {
-    FILE *f = fopen(todo_filename, "w");
-    if (!f) { perror("write"); return; }
-
-    for (int i = 0; i < todo_count; ++i) {
-        Todo *t = &todos[i];
-
-        if (t->completed) {
-            // Save completed format:
-            // x <completion_date> <original_date> @type text [pri:X]
-            fprintf(f, "x %s %s @%s %s", t->completion_date, t->date, t->type, t->text);
-
-        } else {
-            // Save incomplete format:
-            // (X) <date> @type text
-            if (t->priority[0] != '\0')
-                fprintf(f, "%s %s @%s %s", t->priority, t->date, t->type, t->text);
-            else
-                fprintf(f, "%s @%s %s", t->date, t->type, t->text);
+    mbstate_t st;
+    memset(&st, 0, sizeof st);
+    for (size_t len = strlen(s); len > 0 && col < row_width; ) {
+        wchar_t wc;
+        size_t used = mbrtowc(&wc, s, len, &st);
+        if (used == (size_t)-1 || used == (size_t)-2) {
+            wc = L'?';
+            used = 1;
+            memset(&st, 0, sizeof st);
+        } else if (used == 0) {
+            break;
         }
-
-        fputc('\n', f);
+        s += used;
+        len -= used;
+
+        int w = wcwidth(wc);
+        if (w == 0 && col > 0) {
+            // combining mark: joins the character before it
+            int lead = col - 1;
+            while (lead > 0 && row_cont[lead]) --lead;
+            wchar_t chars[CCHARW_MAX + 1];
+            attr_t a;
+            short pair;
+            if (getcchar(&row_grid[lead], chars, &a, &pair, NULL) == OK) {
+                size_t k = wcslen(chars);
+                if (k < CCHARW_MAX) {
+                    chars[k] = wc;
+                    chars[k + 1] = L'\0';
+                    setcchar(&row_grid[lead], chars, a, pair, NULL);
+                }
+            }
+            continue;
+        }
+        wchar_t one[2] = { w < 0 ? L'?' : wc, L'\0' };
+        if (w < 0) w = 1;
+        if (col + w > row_width) break;
+        row_set(col, one, w, attr);
+        col += w;
     }
-
-    fclose(f);
+    return col;
 }
 
+static int row_putf(int col, attr_t attr, const char *fmt, ...)
+{
+    char buf[MAX_LINE * 2];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof buf, fmt, ap);
+    va_end(ap);
+    return row_put(col, buf, attr);
+}
 
-/* ───────────────────────────────────────────── logic ── */
-static void toggle_completed(int visible_index)
+static size_t rows_bytes(void)
 {
-    int shown = 0;
-    for (int i = 0; i < todo_count; ++i) {
-        Todo *t = &todos[i];
-if (strcmp(types[selected_type], "all") != 0 &&
-    strcmp(t->type, types[selected_type]) != 0) continue;
-
-        if (shown == visible_index) {
-            t->completed = !t->completed;
-
-            if (t->completed) {
-                // Set today's date
-                time_t now = time(NULL);
-                struct tm *tm_now = localtime(&now);
-                strftime(t->completion_date, sizeof t->completion_date, "%Y-%m-%d", tm_now);
-
-                // If priority exists, move it to end of text as "pri:X"
-                if (t->priority[0] == '(' && t->priority[2] == ')') {
-                    char pri_tag[8];
-                    snprintf(pri_tag, sizeof pri_tag, " pri:%c", t->priority[1]);
-
-                    // Only append if not already there
-                    if (!strstr(t->text, pri_tag) &&
-                        strlen(t->text) + strlen(pri_tag) < MAX_LINE) {
-                        strcat(t->text, pri_tag);
-                    }
+    size_t bytes = 0;
+    for (int id = 0; id < MAX_TODOS; ++id)
+        if (row_cache[id].cells) bytes += (size_t)row_cache[id].width * sizeof(cchar_t);
+    return bytes;
+}
 
-                    // Clear priority field
-                    t->priority[0] = '\0';
-                }
-    // 🔽 ADD THIS LINE to trigger exec hook
-    run_exec_hook("Completed: ", t->text);
-            } else {
-                t->completion_date[0] = '\0';
-
-                // On un-complete: detect and extract "pri:X" from end of text
-                char *pri = strstr(t->text, " pri:");
-                if (pri && strlen(pri) == 6 && isalpha((unsigned char)pri[5])) {
-                    // Restore priority
-                    snprintf(t->priority, sizeof t->priority, "(%c)", pri[5]);
-
-                    // Remove it from the end of text
-                    *pri = '\0';
-
-                    // Also trim trailing whitespace just in case
-                    size_t len = strlen(t->text);
-                    while (len > 0 && isspace((unsigned char)t->text[len - 1])) {
-                        t->text[len - 1] = '\0';
-                        len--;
-                    }
-                }
-    // 🔽 ADD THIS LINE to trigger exec hook
-    run_exec_hook("Uncompleted: ", t->text);
-            }
+static void rows_shed(void)
+{
+    for (int id = 0; id < MAX_TODOS; ++id) {
+        free(row_cache[id].cells);
+        row_cache[id] = (RowCache){ 0 };
+    }
+}
 
-            save_todos_to_file();
-            return;
+/* the cells of list row k (item t), from the cache or built now */
+static const RowCache *list_row(const Todo *t, int k, bool is_sel, bool all)
+{
+    RowCache *rc = &row_cache[t->id];
+    int width = COLS < (int)(sizeof row_grid / sizeof *row_grid) ? COLS : (int)(sizeof row_grid / sizeof *row_grid);
+    int depth = view_depth(k);
+    if (rc->valid && rc->version == row_version[t->id] && rc->sel == is_sel && rc->all == all &&
+        rc->width == width && rc->depth == depth && rc->done == tree_done[t->id] &&
+        rc->total == tree_total[t->id] && rc->folded == tree_folded[t->id])
+        return rc;
+
+    row_width = width;
+    for (int c = 0; c < width; ++c) setcchar(&row_grid[c], L" ", A_NORMAL, 0, NULL);
+    memset(row_cont, 0, (size_t)width);
+
+    int type_col = all ? LIST_PRIO_COL + 6 : -1;
+    int text_col = all ? type_col + 8 : LIST_PRIO_COL + 6;
+
+    attr_t date_attr, text_attr;
+    if (t->completed) {
+        date_attr = is_sel ? (COLOR_PAIR(7) | A_BOLD) : (COLOR_PAIR(6) | A_DIM);
+        text_attr = COLOR_PAIR(5) | (is_sel ? A_BOLD : A_DIM);
+    } else {
+        date_attr = is_sel ? (COLOR_PAIR(4) | A_BOLD) : COLOR_PAIR(3);
+        text_attr = is_sel ? (COLOR_PAIR(1) | A_BOLD) : COLOR_PAIR(1);
+    }
+    row_put(LIST_DATE_COL, t->date, date_attr);
+
+    // Color the priorities
+    if (*t->priority) {
+        int prio_color;
+        switch (t->priority[1]) {
+            case 'A': prio_color = 11; break;
+            case 'B': prio_color = 12; break;
+            case 'C': prio_color = 13; break;
+            case 'D': prio_color = 14; break;
+            case 'E': prio_color = 15; break;
+            case 'F': prio_color = 16; break;
+            default:  prio_color = 5;  break; // fallback gray
         }
+        row_putf(LIST_PRIO_COL, (date_attr & ~A_COLOR) | COLOR_PAIR(prio_color) | A_BOLD, "%-4s", t->priority);
+    } else {
+        row_put(LIST_PRIO_COL, "    ", date_attr);
+    }
+
+    if (all) {
+        int type_color = strcmp(t->type, "all") == 0 ? 9 : 8;  // magenta for "all", cyan otherwise
+        row_put(type_col, "@", (date_attr & ~A_COLOR) | COLOR_PAIR(10) | A_DIM);   // Lighter @
+        row_putf(type_col + 1, (date_attr & ~A_COLOR) | COLOR_PAIR(type_color), "%-6s", t->type);
+    }
 
-        ++shown;
+    // subtasks: indented, with a fold marker and progress on parents
+    int indent = 2 * depth;
+    if (tree_total[t->id] > 0) {
+        row_put(text_col + indent, tree_folded[t->id] ? "+ " : "- ", COLOR_PAIR(6));
+        indent += 2;
+    }
+    int end = row_put(text_col + indent, t->text, text_attr);
+    if (tree_total[t->id] > 0)
+        row_putf(end, COLOR_PAIR(5), "  [%d/%d]", tree_done[t->id], tree_total[t->id]);
+
+    // wide characters take one cell of the array
+    if (rc->width < width || !rc->cells) {
+        free(rc->cells);
+        rc->cells = malloc((size_t)width * sizeof *rc->cells);
+        if (!rc->cells) { rc->valid = false; return NULL; }
     }
+    int n = 0;
+    for (int c = 0; c < width; ++c)
+        if (!row_cont[c]) rc->cells[n++] = row_grid[c];
+
+    rc->n = n;
+    rc->version = row_version[t->id];
+    rc->sel = is_sel;
+    rc->all = all;
+    rc->width = width;
+    rc->depth = depth;
+    rc->done = tree_done[t->id];
+    rc->total = tree_total[t->id];
+    rc->folded = tree_folded[t->id];
+    rc->valid = true;
+    return rc;
 }
 
+/* switch to the item's context and select it */
+static void jump_to_todo(const Todo *target)
+{
+    for (int i = 0; i < type_count; ++i) {
+        if (strcmp(types[i], target->type) == 0) {
+            selected_type = i;
+            break;
+        }
+    }
 
-/* ───────────────────────────────────────────── UI ── */
+    selected_index = view_rank(target);
+}
 
 static void draw_ui(void)
 {
     /* list */
-    const int DATE_COL = 2;
-    const int PRIO_COL = 13;              /* 2 + 10 + 1 */
-//    const int TEXT_COL = 18;              /* 13 + 4 + 1 */
-int TEXT_COL;
-int TYPE_COL = -1;
-
-if (strcmp(types[selected_type], "all") == 0) {
-    TYPE_COL = PRIO_COL + 6;
-    TEXT_COL = TYPE_COL + 8;
-} else {
-    TEXT_COL = PRIO_COL + 6;
-}
-
+    bool all = strcmp(types[selected_type], "all") == 0;   // rows show the @context column
 
     erase();
 
@@ -590,11 +7737,44 @@ if (strcmp(types[selected_type], "all") == 0) {
         attron(COLOR_PAIR(2) | A_BOLD);
         mvprintw(0, 0, "HELP — press any key");
         attroff(COLOR_PAIR(2) | A_BOLD);
-        mvprintw(2, 2, "j/k        move up / down");
-        mvprintw(3, 2, "h/l        switch context");
-        mvprintw(4, 2, "SPACE      toggle completed");
-        mvprintw(5, 2, "?          help");
-        mvprintw(6, 2, "q          quit");
+        // generated from the keymap, so it shows what is actually bound
+        int per_col = LINES - 3 > 0 ? LINES - 3 : 1, shown = 0;
+        for (int a = ACT_QUIT; a < ACT_COUNT; ++a) {
+            char keys[64];
+            keys_for_action(a, keys, sizeof keys);
+            if (!keys[0]) continue;
+            mvprintw(2 + shown % per_col, 2 + (shown / per_col) * 40,
+                     "%-10s %s", keys, action_names[a]);
+            shown++;
+        }
+        wnoutrefresh(stdscr);
+        doupdate();
+        return;
+    }
+
+    if (show_analytics) {
+        draw_analytics_panel();
+        wnoutrefresh(stdscr);
+        doupdate();
+        return;
+    }
+
+    if (show_next) {
+        draw_next_panel();
+        wnoutrefresh(stdscr);
+        doupdate();
+        return;
+    }
+
+    if (show_notes) {
+        draw_notes_panel();
+        wnoutrefresh(stdscr);
+        doupdate();
+        return;
+    }
+
+    if (show_grep) {
+        draw_grep_panel();
         wnoutrefresh(stdscr);
         doupdate();
         return;
@@ -613,6 +7793,41 @@ attroff(COLOR_PAIR(8));
 attroff(COLOR_PAIR(9));
 attroff(COLOR_PAIR(2) | A_BOLD);
 
+    if (insert_mode != INSERT_AFTER) {
+        attron(COLOR_PAIR(6));
+        printw("   [new: %s]", insert_mode == INSERT_TOP ? "top" : "bottom");
+        attroff(COLOR_PAIR(6));
+    }
+
+    if (filter_on) {
+        attron(COLOR_PAIR(6));
+        printw("   /%s/ %d", filter_src, view_count());
+        attroff(COLOR_PAIR(6));
+    } else if (filter_error[0]) {
+        attron(COLOR_PAIR(11));
+        printw("   regex: %s", filter_error);
+        attroff(COLOR_PAIR(11));
+    }
+
+    /* numeric tag totals for the current view */
+    double filter_sums[MAX_TAG_COLS];
+    const double *sums = strcmp(types[selected_type], "all") == 0
+                       ? all_sums : ctx_sums[selected_type];
+    if (filter_on) {
+        tags_totals(filter_ids, filter_n, filter_sums);
+        sums = filter_sums;
+    }
+    for (int c = 0; c < tag_col_count; ++c) {
+        char val[32];
+        format_tag_value(val, sizeof val, c, sums[c]);
+        attron(COLOR_PAIR(6));
+        printw("   %s ", tag_keys[c]);
+        attroff(COLOR_PAIR(6));
+        attron(COLOR_PAIR(3));
+        printw("%s", val);
+        attroff(COLOR_PAIR(3));
+    }
+
 
     mvhline(1, 0, '-', COLS);
 
@@ -627,146 +7842,221 @@ attroff(COLOR_PAIR(2) | A_BOLD);
     else if (selected_index >= scroll_offset + visible_lines)
         scroll_offset = selected_index - visible_lines + 1;
 
-    int local_idx = 0;
-    for (int i = 0; i < todo_count; ++i) {
-        Todo *t = &todos[i];
-if (strcmp(types[selected_type], "all") != 0 &&
-    strcmp(t->type, types[selected_type]) != 0) continue;
-
-        if (local_idx++ < scroll_offset) continue;
-        if (row >= LINES) break;
-
-        bool is_sel = (local_idx - 1 == selected_index);
-
-        attr_t date_attr, text_attr;
-        if (t->completed) {
-            date_attr = is_sel ? (COLOR_PAIR(7) | A_BOLD)
-                               : (COLOR_PAIR(6) | A_DIM);
-            text_attr = COLOR_PAIR(5) | (is_sel ? A_BOLD : A_DIM);
-        } else {
-            date_attr = is_sel ? (COLOR_PAIR(4) | A_BOLD)
-                               : COLOR_PAIR(3);
-            text_attr = is_sel ? (COLOR_PAIR(1) | A_BOLD)
-                               : COLOR_PAIR(1);
-        }
-
-        attron(date_attr);
-        mvprintw(row, DATE_COL, "%s", t->date);
+    int count = view_count();
+    for (int k = scroll_offset; k < count && row < LINES; ++k) {
+        const RowCache *rc = list_row(view_at(k), k, k == selected_index, all);
+        if (rc) mvadd_wchnstr(row, 0, rc->cells, rc->n);
 
-		// Non coloring of priority, version:
-//mvprintw(row, PRIO_COL, "%-4s", *t->priority ? t->priority : "");
-
-		// Color the priorities
-if (*t->priority) {
-    char prio = t->priority[1]; // priority letter, e.g., 'A'
-    int prio_color = 0;
-
-    switch (prio) {
-        case 'A': prio_color = 11; break;
-        case 'B': prio_color = 12; break;
-        case 'C': prio_color = 13; break;
-        case 'D': prio_color = 14; break;
-        case 'E': prio_color = 15; break;
-        case 'F': prio_color = 16; break;
-        default:  prio_color = 5;  break; // fallback gray
+        ++row;
     }
 
-    attron(COLOR_PAIR(prio_color) | A_BOLD);
-    mvprintw(row, PRIO_COL, "%-4s", t->priority);
-    attroff(COLOR_PAIR(prio_color) | A_BOLD);
-} else {
-    mvprintw(row, PRIO_COL, "    ");
+    wnoutrefresh(stdscr);
+    doupdate();
 }
 
+/* ───────────────────────────────────────────────────────── pressure ── */
 
+/*
+ * Memory pressure (Linux PSI). A trigger on /proc/pressure/memory fires when
+ * tasks stall on memory for PRESSURE_STALL_US in a PRESSURE_WINDOW_US
+ * window; each firing sheds the next tier of caches that can be rebuilt,
+ * cheapest to rebuild first, and hands the memory back with malloc_trim.
+ * The tier falls back to the first after a quiet minute. Every shed cache
+ * is rebuilt lazily by its owner the next time it is needed.
+ */
+#define PRESSURE_STALL_US  150000
+#define PRESSURE_WINDOW_US 2000000      /* unprivileged triggers need a multiple of 2 s */
+#define PRESSURE_QUIET_MS  60000
 
-if (strcmp(types[selected_type], "all") == 0) {
-//    mvprintw(row, TYPE_COL, "@%-6s", t->type); // Show @type only for 'all'
-if (strcmp(types[selected_type], "all") == 0) {
-    int type_color = strcmp(t->type, "all") == 0 ? 9 : 8;  // magenta for "all", cyan otherwise
-
-    mvaddch(row, TYPE_COL, '@' | COLOR_PAIR(10) | A_DIM);  // Lighter @
-    attron(COLOR_PAIR(type_color));
-    mvprintw(row, TYPE_COL + 1, "%-6s", t->type);
-    attroff(COLOR_PAIR(type_color));
-}
-
+typedef struct {
+    const char *name;
+    size_t    (*bytes)(void);
+    void      (*shed)(void);
+    int         count;                  /* times shed */
+    size_t      freed;                  /* bytes dropped over all of them */
+} ShedTier;
+
+static ShedTier shed_tiers[] = {
+    { "rows",       rows_bytes, rows_shed,  0, 0 },   /* rebuilt on the next draw      */
+    { "analytics",  an_bytes,   an_shed,    0, 0 },   /* archive re-read on next panel */
+    { "completion", comp_bytes, comp_shed,  0, 0 },   /* on the next prompt            */
+    { "trigram",    tri_bytes,  tri_shed,   0, 0 },   /* on the next filter            */
+    { "crypt",      crypt_bytes, crypt_shed, 0, 0 },  /* on the next save: decrypt again */
+};
+#define SHED_TIERS ((int)(sizeof shed_tiers / sizeof *shed_tiers))
+
+static int    pressure_tier = 0;        /* tiers shed by the next event */
+static int    pressure_events = 0;
+static long   pressure_last = 0;        /* now_ms() of the last event */
+static time_t pressure_last_wall = 0;
+
+static void pressure_start(void)
+{
+    char trigger[64];
+    int len = snprintf(trigger, sizeof trigger, "some %d %d", PRESSURE_STALL_US, PRESSURE_WINDOW_US);
+    pressure_fd = open("/proc/pressure/memory", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (pressure_fd >= 0 && write(pressure_fd, trigger, (size_t)len + 1) < 0) {
+        close(pressure_fd);             // no PSI here, or not allowed: run without
+        pressure_fd = -1;
+    }
 }
 
-        attroff(date_attr);
-
-        attron(text_attr);
-        mvprintw(row, TEXT_COL, "%s", t->text);
-        attroff(text_attr);
-
-        ++row;
+/* the trigger fired: shed one more tier, and any below it that grew back */
+static void pressure_event(void)
+{
+    long now = now_ms();
+    if (now - pressure_last > PRESSURE_QUIET_MS) pressure_tier = 0;
+    if (pressure_tier < SHED_TIERS) pressure_tier++;
+    pressure_events++;
+    pressure_last = now;
+    pressure_last_wall = time(NULL);
+
+    for (int i = 0; i < pressure_tier; ++i) {
+        size_t bytes = shed_tiers[i].bytes();
+        if (!bytes) continue;
+        shed_tiers[i].shed();
+        shed_tiers[i].count++;
+        shed_tiers[i].freed += bytes;
     }
+    malloc_trim(0);
+}
 
-    wnoutrefresh(stdscr);
-    doupdate();
+/* JSON for /stats: memory, caches and what pressure has shed */
+static int pressure_stats(char *buf, size_t size)
+{
+    char last[32] = "";
+    if (pressure_last_wall) strftime(last, sizeof last, "%Y-%m-%dT%H:%M:%S", localtime(&pressure_last_wall));
+    int len = snprintf(buf, size, "{\"rss_kb\":%ld,\"pressure\":{\"watching\":%s,\"events\":%d,\"tier\":%d,\"last\":\"%s\"},\"caches\":{",
+                       soak_rss_kb(), pressure_fd >= 0 ? "true" : "false", pressure_events, pressure_tier, last);
+    for (int i = 0; i < SHED_TIERS && len > 0 && (size_t)len < size; ++i)
+        len += snprintf(buf + len, size - (size_t)len, "%s\"%s\":{\"bytes\":%zu,\"shed\":%d,\"freed\":%zu}",
+                        i ? "," : "", shed_tiers[i].name, shed_tiers[i].bytes(), shed_tiers[i].count, shed_tiers[i].freed);
+    if (len > 0 && (size_t)len < size) len += snprintf(buf + len, size - (size_t)len, "}}");
+    return len;
 }
 
 /* ───────────────────────────────────────────── main loop ── */
 
 static void ui_loop(void)
 {
-    for (int ch; (ch = getch()) != 'q'; ) {
+    int pending = 0, sel;
+
+    for (int ch;; ) {
+        // wake up once a minute so scores follow the date rollover
+        // more often when other devices' logs need merging
+        ch = wait_key(sync_dir ? 5 * 1000 : 60 * 1000);
+
+        reap_children();
+        if (ch == ERR) { next_check_day(); escalate_due_items(); sync_poll(); mail_poll(); draw_ui(); continue; }
 
         if (show_help) { show_help = false; draw_ui(); continue; }
 
-        switch (ch) {
-        case ' ':  toggle_completed(selected_index);              break;
-        case '?':  show_help = true;                              break;
-        case 's':  prompt_priority();                             break;
-	case 'p':  // ascending priority
+        if (show_analytics) {
+            if (ch == 'd') an_weekly = false;
+            else if (ch == 'w') an_weekly = true;
+            else show_analytics = false;
+            draw_ui();
+            continue;
+        }
+
+        if (show_notes) {
+            if (ch == 'e') edit_notes();
+            else show_notes = false;
+            draw_ui();
+            continue;
+        }
+
+        if (show_grep) {
+            if (ch == 'j') ++grep_selected;
+            else if (ch == 'k') { if (grep_selected > 0) --grep_selected; }
+            else show_grep = false;
+            draw_ui();
+            continue;
+        }
+
+        if (show_next) {
+            if (ch == 'j') ++next_selected;
+            else if (ch == 'k') { if (next_selected > 0) --next_selected; }
+            else {
+                if (ch == '\n' || ch == KEY_ENTER) {
+                    int ids[MAX_TODOS];
+                    int n = ih_top_n(&next_heap, ids, next_selected + 1);
+                    if (n == next_selected + 1) {
+                        Todo *t = todo_by_id(ids[next_selected]);
+                        if (t) jump_to_todo(t);
+                    }
+                }
+                show_next = false;
+            }
+            draw_ui();
+            continue;
+        }
+
+        int action = key_action(ch, &pending);
+        if (action < 0) continue;
+        if (action == ACT_QUIT) break;
+
+        switch (action) {
+        case ACT_TOGGLE:    toggle_completed(selected_index);     break;
+        case ACT_HELP:      show_help = true;                     break;
+        case ACT_NEXT:      next_check_day();
+                            show_next = true; next_selected = 0;  break;
+        case ACT_ANALYTICS: show_analytics = true;                break;
+        case ACT_PRIORITY:  prompt_priority();                    break;
+	case ACT_SORT_PRIO:  // ascending priority
+    sel = selected_id();
     sort_todos_by_priority(false);
-    selected_index = 0;
-    scroll_offset = 0;
+    restore_selection(sel);
     break;
 
-case 'P':  // descending priority
+case ACT_SORT_PRIO_DESC:  // descending priority
+    sel = selected_id();
     sort_todos_by_priority(true);
-    selected_index = 0;
-    scroll_offset = 0;
+    restore_selection(sel);
     break;
 		
-        case 'j':  if (selected_index + 1 <
-                     count_visible_items_for_type(types[selected_type])) {
+        case ACT_DOWN:  if (selected_index + 1 <
+                     view_count()) {
                         ++selected_index;}                         break;
-        case 'k':  if (selected_index > 0){ --selected_index;  }    break;
-        case 'h':  selected_type = (selected_type - 1 + type_count) % type_count;
-                   selected_index = 0;                            break;
-        case 'l':  selected_type = (selected_type + 1) % type_count;
-                   selected_index = 0;                            break;
-
-case 'd':
+        case ACT_UP:    if (selected_index > 0){ --selected_index;  } break;
+        case ACT_TOP:   selected_index = 0;                       break;
+        case ACT_BOTTOM: selected_index = view_count() > 0 ? view_count() - 1 : 0;
+                                                                  break;
+        case ACT_MOVE_DOWN:   move_selected(+1);                  break;
+        case ACT_MOVE_UP:     move_selected(-1);                  break;
+        case ACT_MOVE_TOP:    move_selected_to_top();             break;
+        case ACT_INSERT_MODE: insert_mode = (insert_mode + 1) % 3; break;
+        case ACT_PREV_CONTEXT: switch_context((selected_type - 1 + type_count) % type_count);
+                                                                  break;
+        case ACT_NEXT_CONTEXT: switch_context((selected_type + 1) % type_count);
+                                                                  break;
+
+case ACT_SORT_DATE:
+    sel = selected_id();
     sort_todos_by_date(false);  // ascending
-    selected_index = 0;
-    scroll_offset = 0;
+    restore_selection(sel);
     break;
 
-case 'D':
+case ACT_SORT_DATE_DESC:
+    sel = selected_id();
     sort_todos_by_date(true);   // descending
-    selected_index = 0;
-    scroll_offset = 0;
+    restore_selection(sel);
     break;
-case 'g':
+case ACT_GROUP:
+    sel = selected_id();
     group_todos_by_completed();
-    selected_index = 0;
-    scroll_offset = 0;
+    restore_selection(sel);
     break;
 
-case 'G':
+case ACT_RESTORE_ORDER:
 				// Restore initial order from file read.
-    load_todos(todo_filename);
-    selected_index = 0;
-    scroll_offset = 0;
+    reload_todos();
     break;
 
-case 'n':
+case ACT_ADD:
     add_new_todo();
     break;
-			case '@': {
+			case ACT_JUMP_CONTEXT: {
     echo();
     curs_set(1);
     char input[MAX_TYPE] = {0};
@@ -779,38 +8069,54 @@ case 'n':
     noecho();
     curs_set(0);
 
-    if (strlen(input) > 0) {
-        // If not already known, add to types
-        bool found = false;
-        for (int i = 0; i < type_count; ++i) {
-            if (strcmp(types[i], input) == 0) {
-                selected_type = i;
-                found = true;
-                break;
-            }
-        }
-        if (!found && type_count < MAX_TODOS) {
-            types[type_count] = strdup(input);
-            selected_type = type_count++;
-        }
-
-        selected_index = 0;
-        scroll_offset = 0;
-    }
+    if (strlen(input) > 0)
+        switch_context(add_type(input));  // known, or a new (empty) context
 
     move(LINES - 1, 0);
     clrtoeol();
     break;
 }
-case 'A':
+case ACT_ARCHIVE:
     archive_completed_todos();
-    selected_index = 0;
-    scroll_offset = 0;
     break;
 
-case 't':
+case ACT_RETYPE:
     prompt_type();
     break;
+
+case ACT_FILTER:
+    prompt_filter();
+    break;
+
+case ACT_FIND_FILES:
+    prompt_grep();
+    break;
+
+case ACT_NOTES:
+    open_notes();
+    break;
+
+case ACT_FOLD:
+    toggle_fold();
+    break;
+
+case ACT_INDENT:
+    reparent_selected(true);
+    break;
+
+case ACT_OUTDENT:
+    reparent_selected(false);
+    break;
+
+case ACT_REPLACE:
+    prompt_replace();
+    break;
+
+case ACT_UNDO:
+    sel = selected_id();
+    undo_last_edit();
+    restore_selection(sel);
+    break;
         }
         draw_ui();
     }
@@ -821,18 +8127,87 @@ case 't':
 int main(int argc, char **argv)
 {
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s <todo-file>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <todo-file> [--exec script] [--hook events script] [--weight type=factor] [--keymap file] [--encrypt|--decrypt] [--sync dir] [--maildir dir] [--http port]\n", argv[0]);
         return 1;
     }
 
-    todo_filename = argv[1];
+    if (strcmp(argv[1], "import") == 0)
+        return run_import(argc, argv);
+    if (strcmp(argv[1], "grep") == 0)
+        return run_grep(argc, argv);
+    if (strcmp(argv[1], "soak") == 0)
+        return run_soak(argc, argv);
+    if (strcmp(argv[1], "check") == 0)
+        return run_check(argc, argv);
+    if (strcmp(argv[1], "diff") == 0)
+        return run_diff(argc, argv);
 
-    // Optional --exec
-    if (argc == 4 && strcmp(argv[2], "--exec") == 0) {
-        exec_script = argv[3];
+    todo_filename = argv[1];
+    int crypt_mode = -1;
+
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--exec") == 0 && i + 1 < argc) {
+            hook_add("all", argv[++i]);
+        } else if (strcmp(argv[i], "--hook") == 0 && i + 2 < argc) {
+            // --hook <events>[,@context][,(A-C)][,tag:value] <script>
+            if (!hook_add(argv[i + 1], argv[i + 2])) {
+                fprintf(stderr, "bad --hook spec: %s\n", argv[i + 1]);
+                return 1;
+            }
+            i += 2;
+        } else if (strcmp(argv[i], "--weight") == 0 && i + 1 < argc) {
+            // --weight <type>=<factor>, scales the context in the next-actions view
+            const char *arg = argv[++i];
+            const char *eq = strchr(arg, '=');
+            if (!eq || ctx_weight_count >= MAX_WEIGHTS) continue;
+            size_t len = (size_t)(eq - arg);
+            if (*arg == '@') { ++arg; --len; }
+            if (len >= MAX_TYPE) len = MAX_TYPE - 1;
+            memcpy(ctx_weights[ctx_weight_count].type, arg, len);
+            ctx_weights[ctx_weight_count].type[len] = '\0';
+            ctx_weights[ctx_weight_count].weight = atof(eq + 1);
+            ctx_weight_count++;
+        } else if (strcmp(argv[i], "--escalate-age") == 0 && i + 1 < argc) {
+            esc_age_days = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--escalate-due") == 0 && i + 1 < argc) {
+            esc_due_days = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--keymap") == 0 && i + 1 < argc) {
+            keymap_file = argv[++i];
+        } else if (strcmp(argv[i], "--encrypt") == 0) {
+            crypt_mode = 1;
+        } else if (strcmp(argv[i], "--decrypt") == 0) {
+            crypt_mode = 0;
+        } else if (strcmp(argv[i], "--sync") == 0 && i + 1 < argc) {
+            sync_dir = argv[++i];
+        } else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc) {
+            snprintf(sync_device, sizeof sync_device, "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--maildir") == 0 && i + 1 < argc) {
+            mail_dir = argv[++i];
+        } else if (strcmp(argv[i], "--mail-context") == 0 && i + 1 < argc) {
+            mail_context = argv[++i];
+        } else if (strcmp(argv[i], "--mail-all") == 0) {
+            mail_all = true;
+        } else if (strcmp(argv[i], "--http") == 0 && i + 1 < argc) {
+            http_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--http-origin") == 0 && i + 1 < argc) {
+            http_origin = argv[++i];
+        }
     }
 selected_type = 0;
+    load_keymap();
+    crypt_start(crypt_mode);
+    if (crypt_on && sync_dir) {
+        // the op logs carry whole lines and are not sealed
+        fprintf(stderr, "--sync: not available for a sealed list, the op logs would be plain text\n");
+        return 1;
+    }
     load_todos(todo_filename);
+    crypt_convert();
+    sync_start();
+    mail_start();
+    escalate_due_items();
+    http_start();
+    pressure_start();
 
     setlocale(LC_ALL, "");
     initscr();